@@ -0,0 +1,456 @@
+/**
+ * generate_osm
+ *
+ * Creates a synthetic OSM file for benchmarking. The data is always the
+ * same for the same options, so results of different runs can be compared.
+ *
+ * Nodes are clustered around some "city centers". Ways are buildings
+ * (closed squares) and roads (linestrings), relations are multipolygons
+ * with two outer ways and one inner ring. With --versions > 1 a history
+ * file with several versions of each object is created.
+ *
+ * The code in this file is released into the Public Domain.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <getopt.h>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <osmium/builder/osm_object_builder.hpp>
+#include <osmium/io/any_output.hpp>
+#include <osmium/io/header.hpp>
+#include <osmium/memory/buffer.hpp>
+#include <osmium/osm/location.hpp>
+#include <osmium/osm/timestamp.hpp>
+
+namespace {
+
+constexpr const std::size_t buffer_size = 10UL * 1024UL * 1024UL;
+
+// All objects are created in this area (around Bremen, Germany).
+constexpr const double min_lon = 8.5;
+constexpr const double min_lat = 52.9;
+constexpr const double max_lon = 9.1;
+constexpr const double max_lat = 53.3;
+
+constexpr const double pi = 3.14159265358979323846;
+
+// Size of buildings in degrees
+constexpr const double building_size = 0.0002;
+
+struct Options {
+    std::size_t nodes = 1000000;
+    std::size_t ways = 0; // default is nodes / 10
+    std::size_t multipolygons = 0; // default is ways / 100
+    unsigned int versions = 1;
+    unsigned int clusters = 10;
+    uint64_t seed = 1;
+};
+
+/**
+ * Random numbers which are the same on all platforms. (The distributions
+ * in the standard library are implementation defined, the engine is not.)
+ */
+class Random {
+
+    std::mt19937_64 m_engine;
+
+public:
+
+    explicit Random(uint64_t seed) :
+        m_engine(seed) {
+    }
+
+    // uniform in [0, 1)
+    double uniform() {
+        return static_cast<double>(m_engine() >> 11U) * 0x1.0p-53;
+    }
+
+    double uniform(double min, double max) {
+        return min + uniform() * (max - min);
+    }
+
+    // uniform in [0, max)
+    std::size_t index(std::size_t max) {
+        return static_cast<std::size_t>(uniform() * static_cast<double>(max));
+    }
+
+    // normal distribution (Box-Muller)
+    double normal(double sigma) {
+        const double u = 1.0 - uniform();
+        return sigma * std::sqrt(-2.0 * std::log(u)) * std::cos(2.0 * pi * uniform());
+    }
+
+}; // class Random
+
+struct way {
+    std::vector<osmium::object_id_type> nodes;
+    const char* key;
+    const char* value;
+};
+
+struct relation {
+    std::vector<osmium::object_id_type> outer;
+    osmium::object_id_type inner;
+};
+
+class Generator {
+
+    Options m_options;
+    Random m_random;
+    std::vector<osmium::Location> m_cluster_centers;
+    std::vector<osmium::Location> m_locations;
+    std::vector<way> m_ways;
+    std::vector<relation> m_relations;
+    osmium::memory::Buffer m_buffer{buffer_size, osmium::memory::Buffer::auto_grow::yes};
+
+    // Versions are spread over these years
+    const osmium::Timestamp m_start_time{"2010-01-01T00:00:00Z"};
+    const uint32_t m_time_range = 10U * 365U * 24U * 60U * 60U;
+
+    osmium::Location random_location() {
+        const auto& center = m_cluster_centers[m_random.index(m_cluster_centers.size())];
+        const double lon = std::min(std::max(center.lon() + m_random.normal(0.02), min_lon), max_lon);
+        const double lat = std::min(std::max(center.lat() + m_random.normal(0.02), min_lat), max_lat);
+        return osmium::Location{lon, lat};
+    }
+
+    osmium::object_id_type add_node(const osmium::Location& location) {
+        m_locations.push_back(location);
+        return static_cast<osmium::object_id_type>(m_locations.size());
+    }
+
+    // Add the four corner nodes of a square around a random location.
+    std::vector<osmium::object_id_type> add_square(double size) {
+        const osmium::Location center = random_location();
+        const double d = size / 2;
+        return {
+            add_node(osmium::Location{center.lon() - d, center.lat() - d}),
+            add_node(osmium::Location{center.lon() + d, center.lat() - d}),
+            add_node(osmium::Location{center.lon() + d, center.lat() + d}),
+            add_node(osmium::Location{center.lon() - d, center.lat() + d})
+        };
+    }
+
+    void add_building() {
+        auto nodes = add_square(building_size);
+        nodes.push_back(nodes.front());
+        m_ways.push_back(way{std::move(nodes), "building", "yes"});
+    }
+
+    void add_road() {
+        std::vector<osmium::object_id_type> nodes;
+        osmium::Location location = random_location();
+        const std::size_t num_nodes = 2 + m_random.index(9);
+        for (std::size_t i = 0; i < num_nodes; ++i) {
+            nodes.push_back(add_node(location));
+            location.set_lon(std::min(std::max(location.lon() + m_random.normal(0.001), min_lon), max_lon));
+            location.set_lat(std::min(std::max(location.lat() + m_random.normal(0.001), min_lat), max_lat));
+        }
+        m_ways.push_back(way{std::move(nodes), "highway", "residential"});
+    }
+
+    // A multipolygon with the outer ring split into two ways and one
+    // inner ring in the middle.
+    void add_multipolygon() {
+        const auto outer = add_square(building_size * 10);
+        const auto id = static_cast<osmium::object_id_type>(m_ways.size());
+        m_ways.push_back(way{{outer[0], outer[1], outer[2]}, nullptr, nullptr});
+        m_ways.push_back(way{{outer[2], outer[3], outer[0]}, nullptr, nullptr});
+
+        const osmium::Location& sw = m_locations[outer[0] - 1];
+        // The outer square is 10 building sizes wide, the inner ring covers
+        // 4 to 6 building sizes from its south-west corner.
+        const double d = building_size;
+        std::vector<osmium::object_id_type> inner{
+            add_node(osmium::Location{sw.lon() + 4 * d, sw.lat() + 4 * d}),
+            add_node(osmium::Location{sw.lon() + 6 * d, sw.lat() + 4 * d}),
+            add_node(osmium::Location{sw.lon() + 6 * d, sw.lat() + 6 * d}),
+            add_node(osmium::Location{sw.lon() + 4 * d, sw.lat() + 6 * d})
+        };
+        inner.push_back(inner.front());
+        m_ways.push_back(way{std::move(inner), nullptr, nullptr});
+
+        m_relations.push_back(relation{{id + 1, id + 2}, id + 3});
+    }
+
+    // Timestamps of the versions of an object, sorted
+    std::vector<osmium::Timestamp> timestamps() {
+        std::vector<osmium::Timestamp> result;
+        const unsigned int num_versions = 1 + static_cast<unsigned int>(m_random.index(m_options.versions));
+        for (unsigned int v = 0; v < num_versions; ++v) {
+            result.emplace_back(uint32_t(m_start_time) + static_cast<uint32_t>(m_random.index(m_time_range)));
+        }
+        std::sort(result.begin(), result.end());
+        return result;
+    }
+
+    template <typename TBuilder>
+    void set_attributes(TBuilder& builder, osmium::object_id_type id, std::size_t version, const osmium::Timestamp& timestamp) {
+        builder.set_id(id);
+        builder.set_version(static_cast<osmium::object_version_type>(version));
+        builder.set_timestamp(timestamp);
+        builder.set_changeset(static_cast<osmium::changeset_id_type>(1 + m_random.index(1000000)));
+        builder.set_uid(static_cast<osmium::user_id_type>(1 + m_random.index(1000)));
+        builder.set_visible(true);
+        builder.set_user("benchmark");
+    }
+
+    void flush_if_full(osmium::io::Writer& writer) {
+        if (m_buffer.committed() > buffer_size - 1024UL * 1024UL) {
+            writer(std::move(m_buffer));
+            m_buffer = osmium::memory::Buffer{buffer_size, osmium::memory::Buffer::auto_grow::yes};
+        }
+    }
+
+    void write_nodes(osmium::io::Writer& writer) {
+        osmium::object_id_type id = 0;
+        for (const auto& original_location : m_locations) {
+            ++id;
+            osmium::Location location = original_location;
+            const auto ts = timestamps();
+            for (std::size_t v = 0; v < ts.size(); ++v) {
+                // Later versions move the node a little bit (but only
+                // while it isn't the current version).
+                const bool last = v + 1 == ts.size();
+                {
+                    osmium::builder::NodeBuilder builder{m_buffer};
+                    set_attributes(builder, id, v + 1, ts[v]);
+                    builder.set_location(last ? original_location : location);
+                    if (id % 50 == 0) {
+                        osmium::builder::TagListBuilder tl_builder{builder};
+                        tl_builder.add_tag("amenity", "restaurant");
+                    }
+                }
+                m_buffer.commit();
+                location.set_lon(original_location.lon() + m_random.normal(0.00001));
+                location.set_lat(original_location.lat() + m_random.normal(0.00001));
+            }
+            flush_if_full(writer);
+        }
+    }
+
+    void write_ways(osmium::io::Writer& writer) {
+        osmium::object_id_type id = 0;
+        for (const auto& w : m_ways) {
+            ++id;
+            const auto ts = timestamps();
+            for (std::size_t v = 0; v < ts.size(); ++v) {
+                {
+                    osmium::builder::WayBuilder builder{m_buffer};
+                    set_attributes(builder, id, v + 1, ts[v]);
+                    {
+                        osmium::builder::WayNodeListBuilder wnl_builder{builder};
+                        for (const auto ref : w.nodes) {
+                            wnl_builder.add_node_ref(ref);
+                        }
+                    }
+                    // The tags appear in the second version if there
+                    // are several.
+                    if (w.key && (v > 0 || ts.size() == 1)) {
+                        osmium::builder::TagListBuilder tl_builder{builder};
+                        tl_builder.add_tag(w.key, w.value);
+                    }
+                }
+                m_buffer.commit();
+            }
+            flush_if_full(writer);
+        }
+    }
+
+    void write_relations(osmium::io::Writer& writer) {
+        osmium::object_id_type id = 0;
+        for (const auto& r : m_relations) {
+            ++id;
+            const auto ts = timestamps();
+            for (std::size_t v = 0; v < ts.size(); ++v) {
+                {
+                    osmium::builder::RelationBuilder builder{m_buffer};
+                    set_attributes(builder, id, v + 1, ts[v]);
+                    {
+                        osmium::builder::RelationMemberListBuilder rml_builder{builder};
+                        for (const auto ref : r.outer) {
+                            rml_builder.add_member(osmium::item_type::way, ref, "outer");
+                        }
+                        // The inner ring appears in the second version if
+                        // there are several.
+                        if (v > 0 || ts.size() == 1) {
+                            rml_builder.add_member(osmium::item_type::way, r.inner, "inner");
+                        }
+                    }
+                    {
+                        osmium::builder::TagListBuilder tl_builder{builder};
+                        tl_builder.add_tag("type", "multipolygon");
+                        tl_builder.add_tag("building", "yes");
+                    }
+                }
+                m_buffer.commit();
+            }
+            flush_if_full(writer);
+        }
+    }
+
+public:
+
+    explicit Generator(const Options& options) :
+        m_options(options),
+        m_random(options.seed) {
+        for (unsigned int i = 0; i < options.clusters; ++i) {
+            m_cluster_centers.emplace_back(m_random.uniform(min_lon, max_lon), m_random.uniform(min_lat, max_lat));
+        }
+
+        // Create multipolygons and ways first, so that their nodes come
+        // first, the rest of the nodes are points of interest.
+        for (std::size_t i = 0; i < options.multipolygons; ++i) {
+            add_multipolygon();
+        }
+        while (m_ways.size() < options.ways) {
+            if (m_random.index(2) == 0) {
+                add_building();
+            } else {
+                add_road();
+            }
+        }
+        while (m_locations.size() < options.nodes) {
+            add_node(random_location());
+        }
+    }
+
+    void write(const std::string& filename) {
+        osmium::io::File file{filename};
+        osmium::io::Header header;
+        header.set("generator", "osmium-contrib generate_osm");
+        header.set_has_multiple_object_versions(m_options.versions > 1);
+        header.add_box(osmium::Box{min_lon, min_lat, max_lon, max_lat});
+
+        osmium::io::Writer writer{file, header, osmium::io::overwrite::allow};
+        write_nodes(writer);
+        write_ways(writer);
+        write_relations(writer);
+        writer(std::move(m_buffer));
+        writer.close();
+    }
+
+    std::size_t num_nodes() const noexcept {
+        return m_locations.size();
+    }
+
+    std::size_t num_ways() const noexcept {
+        return m_ways.size();
+    }
+
+    std::size_t num_relations() const noexcept {
+        return m_relations.size();
+    }
+
+}; // class Generator
+
+void print_help(const char* progname) {
+    std::cerr << "Usage: " << progname << " [OPTIONS] OUTFILE\n";
+    std::cerr << "Create a synthetic OSM file for benchmarks. The same options always\n";
+    std::cerr << "create the same data. The file format is taken from the suffix.\n";
+    std::cerr << "   --help | -h                    this help\n";
+    std::cerr << "   --nodes <n> | -n <n>           number of nodes (at least) [1000000]\n";
+    std::cerr << "   --ways <n> | -w <n>            number of ways [nodes / 10]\n";
+    std::cerr << "   --multipolygons <n> | -m <n>   number of multipolygon relations\n";
+    std::cerr << "                                  [ways / 100]\n";
+    std::cerr << "   --versions <n> | -v <n>        maximum number of versions per object,\n";
+    std::cerr << "                                  creates a history file if > 1 [1]\n";
+    std::cerr << "   --clusters <n> | -c <n>        number of clusters of nodes [10]\n";
+    std::cerr << "   --seed <n> | -s <n>            seed for random numbers [1]\n";
+}
+
+} // anonymous namespace
+
+int main(int argc, char* argv[]) {
+    Options options;
+    bool ways_set = false;
+    bool multipolygons_set = false;
+
+    static struct option long_options[] = {
+       { "help",          no_argument,       0, 'h' },
+       { "nodes",         required_argument, 0, 'n' },
+       { "ways",          required_argument, 0, 'w' },
+       { "multipolygons", required_argument, 0, 'm' },
+       { "versions",      required_argument, 0, 'v' },
+       { "clusters",      required_argument, 0, 'c' },
+       { "seed",          required_argument, 0, 's' },
+       { 0, 0, 0, 0 } };
+
+    while (true) {
+        const int c = getopt_long(argc, argv, "hn:w:m:v:c:s:", long_options, 0);
+        if (c == -1) {
+            break;
+        }
+
+        switch (c) {
+            case 'h':
+                print_help(argv[0]);
+                std::exit(0);
+            case 'n':
+                options.nodes = std::strtoul(optarg, nullptr, 10);
+                break;
+            case 'w':
+                options.ways = std::strtoul(optarg, nullptr, 10);
+                ways_set = true;
+                break;
+            case 'm':
+                options.multipolygons = std::strtoul(optarg, nullptr, 10);
+                multipolygons_set = true;
+                break;
+            case 'v':
+                options.versions = static_cast<unsigned int>(std::strtoul(optarg, nullptr, 10));
+                if (options.versions == 0) {
+                    std::cerr << "Number of versions must be at least 1.\n";
+                    std::exit(1);
+                }
+                break;
+            case 'c':
+                options.clusters = static_cast<unsigned int>(std::strtoul(optarg, nullptr, 10));
+                if (options.clusters == 0) {
+                    std::cerr << "Number of clusters must be at least 1.\n";
+                    std::exit(1);
+                }
+                break;
+            case 's':
+                options.seed = std::strtoull(optarg, nullptr, 10);
+                break;
+            default:
+                print_help(argv[0]);
+                std::exit(1);
+        }
+    }
+
+    if (argc - optind != 1) {
+        print_help(argv[0]);
+        std::exit(1);
+    }
+
+    if (!ways_set) {
+        options.ways = options.nodes / 10;
+    }
+    if (!multipolygons_set) {
+        options.multipolygons = options.ways / 100;
+    }
+
+    try {
+        Generator generator{options};
+        generator.write(argv[optind]);
+        std::cerr << "Created " << generator.num_nodes() << " nodes, "
+                  << generator.num_ways() << " ways, and "
+                  << generator.num_relations() << " relations";
+        if (options.versions > 1) {
+            std::cerr << " (with up to " << options.versions << " versions each)";
+        }
+        std::cerr << ".\n";
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << '\n';
+        std::exit(1);
+    }
+}
@@ -0,0 +1,184 @@
+/**
+ * run_benchmark
+ *
+ * Runs a command and reports the wall clock time, the number of objects
+ * processed per second, and the peak memory use of the command. Results
+ * can be appended to a file (one JSON object per line) to track them over
+ * time.
+ *
+ * The code in this file is released into the Public Domain.
+ */
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <ctime>
+#include <exception>
+#include <fcntl.h>
+#include <fstream>
+#include <getopt.h>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <sys/resource.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <osmium/io/any_input.hpp>
+#include <osmium/osm/entity_bits.hpp>
+
+namespace {
+
+void print_help(const char* progname) {
+    std::cerr << "Usage: " << progname << " [OPTIONS] -- COMMAND [ARGS...]\n";
+    std::cerr << "Run COMMAND and report time, throughput, and peak memory use.\n";
+    std::cerr << "The output of the command on stdout is thrown away.\n";
+    std::cerr << "   --help | -h              this help\n";
+    std::cerr << "   --name <name> | -n <name>\n";
+    std::cerr << "                            name of the benchmark [COMMAND]\n";
+    std::cerr << "   --input <file> | -i <file>\n";
+    std::cerr << "                            count objects in this OSM file to calculate\n";
+    std::cerr << "                            the throughput (not part of the timing)\n";
+    std::cerr << "   --results <file> | -r <file>\n";
+    std::cerr << "                            append results as JSON to this file\n";
+}
+
+uint64_t count_objects(const std::string& filename) {
+    uint64_t count = 0;
+    osmium::io::Reader reader{filename, osmium::osm_entity_bits::object};
+    while (osmium::memory::Buffer buffer = reader.read()) {
+        count += static_cast<uint64_t>(std::distance(buffer.begin(), buffer.end()));
+    }
+    reader.close();
+    return count;
+}
+
+// Run the command, return the exit status and resource usage.
+int run(char* argv[], struct rusage& usage) {
+    const pid_t pid = fork();
+    if (pid < 0) {
+        std::cerr << "Can not fork\n";
+        std::exit(1);
+    }
+
+    if (pid == 0) { // child
+        const int fd = open("/dev/null", O_WRONLY);
+        if (fd >= 0) {
+            dup2(fd, 1);
+            close(fd);
+        }
+        execvp(argv[0], argv);
+        std::cerr << "Can not run '" << argv[0] << "'\n";
+        std::_Exit(127);
+    }
+
+    int status = 0;
+    if (wait4(pid, &status, 0, &usage) < 0) {
+        std::cerr << "Error waiting for command\n";
+        std::exit(1);
+    }
+
+    if (WIFEXITED(status)) {
+        return WEXITSTATUS(status);
+    }
+    return 128 + WTERMSIG(status);
+}
+
+} // anonymous namespace
+
+int main(int argc, char* argv[]) {
+    std::string name;
+    std::string input;
+    std::string results;
+
+    static struct option long_options[] = {
+       { "help",    no_argument,       0, 'h' },
+       { "name",    required_argument, 0, 'n' },
+       { "input",   required_argument, 0, 'i' },
+       { "results", required_argument, 0, 'r' },
+       { 0, 0, 0, 0 } };
+
+    while (true) {
+        const int c = getopt_long(argc, argv, "+hn:i:r:", long_options, 0);
+        if (c == -1) {
+            break;
+        }
+
+        switch (c) {
+            case 'h':
+                print_help(argv[0]);
+                std::exit(0);
+            case 'n':
+                name = optarg;
+                break;
+            case 'i':
+                input = optarg;
+                break;
+            case 'r':
+                results = optarg;
+                break;
+            default:
+                print_help(argv[0]);
+                std::exit(1);
+        }
+    }
+
+    if (optind >= argc) {
+        print_help(argv[0]);
+        std::exit(1);
+    }
+
+    if (name.empty()) {
+        name = argv[optind];
+    }
+
+    uint64_t objects = 0;
+    if (!input.empty()) {
+        try {
+            objects = count_objects(input);
+        } catch (const std::exception& e) {
+            std::cerr << e.what() << '\n';
+            std::exit(1);
+        }
+    }
+
+    struct rusage usage{};
+    const auto start = std::chrono::steady_clock::now();
+    const int exit_code = run(argv + optind, usage);
+    const std::chrono::duration<double> duration = std::chrono::steady_clock::now() - start;
+
+    const double seconds = duration.count();
+    const double user_seconds = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6;
+    const double system_seconds = usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+    const long peak_kbytes = usage.ru_maxrss; // kBytes on Linux
+    const double objects_per_second = seconds > 0 ? static_cast<double>(objects) / seconds : 0;
+
+    std::cout << name << ": " << seconds << " s (user " << user_seconds
+              << " s, system " << system_seconds << " s)";
+    if (objects > 0) {
+        std::cout << ", " << objects << " objects, "
+                  << static_cast<uint64_t>(objects_per_second) << " objects/s";
+    }
+    std::cout << ", peak memory " << (peak_kbytes / 1024) << " MBytes";
+    if (exit_code != 0) {
+        std::cout << ", FAILED with exit code " << exit_code;
+    }
+    std::cout << "\n";
+
+    if (!results.empty()) {
+        std::ofstream out{results, std::ios::app};
+        out << "{\"name\":\"" << name << "\""
+            << ",\"time\":" << std::time(nullptr)
+            << ",\"seconds\":" << seconds
+            << ",\"user_seconds\":" << user_seconds
+            << ",\"system_seconds\":" << system_seconds
+            << ",\"objects\":" << objects
+            << ",\"objects_per_second\":" << objects_per_second
+            << ",\"peak_rss_kbytes\":" << peak_kbytes
+            << ",\"exit_code\":" << exit_code
+            << "}\n";
+    }
+
+    return exit_code;
+}
@@ -4,6 +4,14 @@
 #
 #-----------------------------------------------------------------------------
 
+#-----------------------------------------------------------------------------
+#
+#  Headers shared by all projects
+#
+#-----------------------------------------------------------------------------
+include_directories(${CMAKE_CURRENT_LIST_DIR}/../include)
+
+
 #-----------------------------------------------------------------------------
 #
 #  Compiler and Linker flags
@@ -7,10 +7,13 @@
  */
 
 #include <algorithm>
+#include <cstdint>
 #include <cstdlib>
 #include <getopt.h>
 #include <iostream>
 #include <limits>
+#include <stdexcept>
+#include <string>
 #include <utility>
 #include <vector>
 
@@ -20,6 +23,8 @@
 #include <osmium/util/file.hpp>
 #include <osmium/util/progress_bar.hpp>
 
+#include "run_stats.hpp"
+
 void print_help(const char* progname) {
     std::cerr << "Usage: " << progname << " [OPTIONS] OSMFILE\n";
     std::cerr << "List the (meta) tiles in the input file ordered by node density,\n";
@@ -35,6 +40,8 @@ void print_help(const char* progname) {
     std::cerr << "   --single | -s            compute for single tiles, not meta tiles\n";
     std::cerr << "   --count | -c             print number of nodes in each tile\n";
     std::cerr << "   --progress | -p          display progress bar\n";
+    std::cerr << "   --stats-json <file>      write statistics (timing, counters,\n";
+    std::cerr << "                            memory use) as JSON to file\n";
 }
 
 int main(int argc, char* argv[]) {
@@ -46,15 +53,17 @@ int main(int argc, char* argv[]) {
     unsigned int effective_zoom;
     unsigned int max = 100000;
     unsigned int min_nodes = 1;
+    std::string stats_filename;
 
     static struct option long_options[] = {
-       { "help",      no_argument,       0, 'h' },
-       { "zoom",      required_argument, 0, 'z' },
-       { "max",       required_argument, 0, 'm' },
-       { "min-nodes", required_argument, 0, 'M' },
-       { "single",    no_argument,       0, 's' },
-       { "count",     no_argument,       0, 'c' },
-       { "progress",  no_argument,       0, 'p' },
+       { "help",       no_argument,       0, 'h' },
+       { "zoom",       required_argument, 0, 'z' },
+       { "max",        required_argument, 0, 'm' },
+       { "min-nodes",  required_argument, 0, 'M' },
+       { "single",     no_argument,       0, 's' },
+       { "count",      no_argument,       0, 'c' },
+       { "progress",   no_argument,       0, 'p' },
+       { "stats-json", required_argument, 0, 'J' },
        { 0, 0, 0, 0 } };
 
     while (true) {
@@ -81,6 +90,9 @@ int main(int argc, char* argv[]) {
             case 's':
                 single_tile = true;
                 break;
+            case 'J':
+                stats_filename = optarg;
+                break;
             case 'z':
                 zoom = std::atoi(optarg);
                 if ((zoom < 5) || (zoom > 18)) {
@@ -124,6 +136,9 @@ int main(int argc, char* argv[]) {
     // vector holds one counter for each tile
     std::vector<unsigned int> grid(1 << (2 * effective_zoom));
 
+    RunStats stats{"dense_tiles"};
+    auto read_phase = stats.phase("read");
+
     osmium::io::File infile{input};
     osmium::io::Reader reader{infile, osmium::osm_entity_bits::node, osmium::io::read_meta::no};
 
@@ -134,9 +149,11 @@ int main(int argc, char* argv[]) {
     // delivered from input file through the "reader".
     auto input_range = osmium::io::make_input_iterator_range<osmium::OSMObject>(reader);
 
+    uint64_t num_nodes = 0;
     auto callback = [&](const osmium::OSMObject& object) {
         progress.update(reader.offset());
         if (object.type() != osmium::item_type::node) return;
+        ++num_nodes;
         const osmium::Node& n = static_cast<const osmium::Node&>(object);
         // use osmium::geom::Tile to do the coordinate->tile conversion
         osmium::geom::Tile t{effective_zoom, n.location()};
@@ -152,6 +169,10 @@ int main(int argc, char* argv[]) {
     // Progress bar is done.
     progress.done();
     reader.close();
+    read_phase.stop();
+    stats.add("nodes", num_nodes);
+
+    auto sort_phase = stats.phase("sort");
 
     // copy counters to a vector with pairs, remembering the position in
     // grid[] which is the tile coordinate
@@ -169,7 +190,10 @@ int main(int argc, char* argv[]) {
         return left.first > right.first;
     });
 
+    sort_phase.stop();
+
     // dump first "max" elements of sorter vector
+    auto output_phase = stats.phase("output");
     if (max > sorter.size()) max=sorter.size();
     for (unsigned int i=0; i<max; i++) {
         unsigned int y = sorter[i].second >> effective_zoom;
@@ -184,6 +208,16 @@ int main(int argc, char* argv[]) {
         }
         std::cout << "\n";
     }
-
+    output_phase.stop();
+    stats.add("tiles", max);
+
+    if (!stats_filename.empty()) {
+        try {
+            stats.write_json(stats_filename);
+        } catch (const std::runtime_error& e) {
+            std::cerr << e.what() << "\n";
+            std::exit(1);
+        }
+    }
 }
 
@@ -0,0 +1,213 @@
+
+// The code in this file is released into the Public Domain.
+
+#include "cmdline_options.hpp"
+
+#include <boost/program_options.hpp>
+
+#include <iostream>
+
+void Options::add_filter_expression(const std::string& expression) {
+    std::string expr{expression};
+
+    // Optional object type prefix ("n/", "w/", "a/", "nw/", ...).
+    bool nodes = true;
+    bool ways = true;
+    bool areas = true;
+    const auto slash = expr.find('/');
+    if (slash != std::string::npos) {
+        nodes = ways = areas = false;
+        for (const char c : expr.substr(0, slash)) {
+            switch (c) {
+                case 'n':
+                    nodes = true;
+                    break;
+                case 'w':
+                    ways = true;
+                    break;
+                case 'a':
+                    areas = true;
+                    break;
+                default:
+                    std::cerr << "Unknown object type '" << c << "' in filter expression '" << expression << "'.\n";
+                    std::exit(return_code::fatal);
+            }
+        }
+        expr.erase(0, slash + 1);
+    }
+
+    const auto equal = expr.find('=');
+    const std::string key{expr.substr(0, equal)};
+    if (key.empty()) {
+        std::cerr << "Missing key in filter expression '" << expression << "'.\n";
+        std::exit(return_code::fatal);
+    }
+
+    osmium::TagMatcher matcher{key};
+    if (equal != std::string::npos) {
+        std::vector<std::string> values;
+        std::string::size_type start = equal + 1;
+        while (true) {
+            const auto comma = expr.find(',', start);
+            values.push_back(expr.substr(start, comma - start));
+            if (comma == std::string::npos) {
+                break;
+            }
+            start = comma + 1;
+        }
+        matcher = osmium::TagMatcher{key, values};
+    }
+
+    if (nodes) {
+        node_filter.add_rule(true, matcher);
+    }
+    if (ways) {
+        way_filter.add_rule(true, matcher);
+    }
+    if (areas) {
+        area_filter.add_rule(true, matcher);
+    }
+
+    filter_expressions.push_back(expression);
+}
+
+Options::Options(int argc, char* argv[]) {
+    namespace po = boost::program_options;
+
+    po::variables_map vm;
+
+    try {
+        po::options_description cmdline{"Options"};
+        cmdline.add_options()
+            ("help,h", "Print this help message")
+            ("quiet,q", "Suppress verbose output messages")
+            ("format,f", po::value<std::string>(), "Format of input file (default: autodetect)")
+            ("expression,e", po::value<std::vector<std::string>>(), "Only export objects matching filter expression [nwa/]KEY[=VALUE[,VALUE...]] (can be given multiple times)")
+            ("output-directory,o", po::value<std::string>(), "Write output files into this directory instead of STDOUT")
+            ("partitions,p", po::value<std::size_t>(), "Split output spatially into this many files (default: 1)")
+            ("compression,z", po::value<std::string>(), "Compress output with 'gzip' or 'lz4' (default: none)")
+            ("compression-threads", po::value<int>(), "Number of threads for compressing output (default: 0 = number of cores)")
+            ("way-nodes-only,r", "Only store locations of nodes referenced by ways (needs an extra pass)")
+            ("assembler-threads,t", po::value<unsigned int>(), "Number of threads for assembling multipolygon relations (default: 0 = in main thread)")
+            ("max-mp-members", po::value<std::size_t>(), "Assemble multipolygons in batches with at most this many member ways (needs extra passes, default: 0 = no limit)")
+            ("state-directory,S", po::value<std::string>(), "Write state for incremental updates into this directory (or read it with --update)")
+            ("update,u", "Input is a change file, apply it to the state and only write changed geometries")
+            ("stats-json", po::value<std::string>(), "Write statistics (timing, counters, memory use) as JSON to this file")
+        ;
+
+        po::options_description hidden{"Hidden options"};
+        hidden.add_options()
+            ("input-filename", po::value<std::string>(), "Input file")
+        ;
+
+        po::options_description desc{"Usage: export_to_wkt [OPTIONS] OSMFILE\nWrite node, way, and area geometries in WKT format"};
+        desc.add(cmdline);
+
+        po::options_description all;
+        all.add(cmdline).add(hidden);
+
+        po::positional_options_description positional;
+        positional.add("input-filename", 1);
+
+        po::store(po::command_line_parser(argc, argv).options(all).positional(positional).run(), vm);
+        po::notify(vm);
+
+        if (vm.count("help")) {
+            std::cout << desc << "\n";
+            std::exit(0);
+        }
+
+        if (vm.count("quiet")) {
+            vout.verbose(false);
+        }
+
+        if (vm.count("input-filename")) {
+            input_filename = vm["input-filename"].as<std::string>();
+        }
+
+        if (vm.count("format")) {
+            input_format = vm["format"].as<std::string>();
+        }
+
+        if (vm.count("output-directory")) {
+            output_directory = vm["output-directory"].as<std::string>();
+        }
+
+        if (vm.count("partitions")) {
+            partitions = vm["partitions"].as<std::size_t>();
+            if (partitions < 1 || partitions > max_partitions) {
+                std::cerr << "Number of partitions must be between 1 and " << max_partitions << ".\n";
+                std::exit(return_code::fatal);
+            }
+            if (output_directory.empty()) {
+                std::cerr << "Need --output-directory, -o when writing partitioned output.\n";
+                std::exit(return_code::fatal);
+            }
+        }
+
+        if (vm.count("compression")) {
+            const std::string c{vm["compression"].as<std::string>()};
+            if (c == "gzip") {
+                compression = compression_type::gzip;
+            } else if (c == "lz4" && lz4_available()) {
+                compression = compression_type::lz4;
+            } else if (c == "lz4") {
+                std::cerr << "This program was built without LZ4 support.\n";
+                std::exit(return_code::fatal);
+            } else if (c != "none") {
+                std::cerr << "Unknown compression format '" << c << "'.\n";
+                std::exit(return_code::fatal);
+            }
+        }
+
+        if (vm.count("compression-threads")) {
+            compression_threads = vm["compression-threads"].as<int>();
+            if (compression_threads < 0) {
+                std::cerr << "Number of compression threads can not be negative.\n";
+                std::exit(return_code::fatal);
+            }
+        }
+
+        if (vm.count("way-nodes-only")) {
+            way_nodes_only = true;
+        }
+
+        if (vm.count("assembler-threads")) {
+            assembler_threads = vm["assembler-threads"].as<unsigned int>();
+        }
+
+        if (vm.count("max-mp-members")) {
+            max_mp_members = vm["max-mp-members"].as<std::size_t>();
+        }
+
+        if (vm.count("state-directory")) {
+            state_directory = vm["state-directory"].as<std::string>();
+        }
+
+        if (vm.count("update")) {
+            update = true;
+            if (state_directory.empty()) {
+                std::cerr << "Need --state-directory, -S with --update, -u.\n";
+                std::exit(return_code::fatal);
+            }
+            if (partitions > 1) {
+                std::cerr << "Can not write partitioned output with --update, -u.\n";
+                std::exit(return_code::fatal);
+            }
+        }
+
+        if (vm.count("stats-json")) {
+            stats_filename = vm["stats-json"].as<std::string>();
+        }
+
+        if (vm.count("expression")) {
+            for (const auto& expression : vm["expression"].as<std::vector<std::string>>()) {
+                add_filter_expression(expression);
+            }
+        }
+    } catch (const boost::program_options::error& e) {
+        std::cerr << "Error parsing command line: " << e.what() << '\n';
+        std::exit(return_code::fatal);
+    }
+}
+
@@ -0,0 +1,84 @@
+#ifndef CMDLINE_OPTIONS_HPP
+#define CMDLINE_OPTIONS_HPP
+
+// The code in this file is released into the Public Domain.
+
+#include <string>
+#include <vector>
+
+#include <osmium/tags/tags_filter.hpp>
+#include <osmium/util/verbose_output.hpp>
+
+#include "compression.hpp"
+
+enum return_code : int {
+    okay  = 0,
+    error = 1,
+    fatal = 2
+};
+
+struct Options {
+
+    osmium::util::VerboseOutput vout {true};
+
+    std::string input_filename {"-"};
+    std::string input_format;
+
+    // Write to STDOUT if this is empty
+    std::string output_directory;
+    std::size_t partitions = 1;
+
+    // Each partition has its own writer thread and up to about 20 MBytes
+    // of data in flight, so the number must be limited.
+    static constexpr const std::size_t max_partitions = 1024;
+
+    // Output compression and number of threads used for it (0 = number of
+    // cores).
+    compression_type compression = compression_type::none;
+    int compression_threads = 0;
+
+    // Write statistics as JSON to this file if not empty
+    std::string stats_filename;
+
+    // Filter expressions from the command line. If there are none, all
+    // objects are exported.
+    std::vector<std::string> filter_expressions;
+
+    osmium::TagsFilter node_filter {false};
+    osmium::TagsFilter way_filter {false};
+    osmium::TagsFilter area_filter {false};
+
+    // Only store locations of nodes referenced by ways.
+    bool way_nodes_only = false;
+
+    // Assemble multipolygons in batches with at most this many member
+    // ways (0 = all at once).
+    std::size_t max_mp_members = 0;
+
+    // Number of threads assembling multipolygon relations (0 = assemble
+    // in main thread).
+    unsigned int assembler_threads = 0;
+
+    // Directory with the state for incremental updates. A full run writes
+    // it if this is not empty, an update run reads and updates it.
+    std::string state_directory;
+
+    // Input is a change file to be applied to the state.
+    bool update = false;
+
+    Options(int argc, char* argv[]);
+
+    bool filtering() const noexcept {
+        return !filter_expressions.empty();
+    }
+
+    // Do we need an extra pass to find the nodes referenced by ways?
+    bool select_way_nodes() const noexcept {
+        return way_nodes_only || filtering();
+    }
+
+    void add_filter_expression(const std::string& expression);
+
+}; // struct Options
+
+#endif // CMDLINE_OPTIONS_HPP
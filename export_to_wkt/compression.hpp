@@ -0,0 +1,96 @@
+#ifndef COMPRESSION_HPP
+#define COMPRESSION_HPP
+
+// The code in this file is released into the Public Domain.
+
+#include <stdexcept>
+#include <string>
+
+#include <zlib.h>
+
+#ifdef EXPORT_TO_WKT_WITH_LZ4
+# include <lz4frame.h>
+#endif
+
+/**
+ * Output blocks are compressed independently of each other. Each block
+ * becomes a complete gzip member or LZ4 frame, the concatenation of them
+ * is a valid compressed file which can be read with the usual tools.
+ */
+enum class compression_type {
+    none,
+    gzip,
+    lz4
+};
+
+inline bool lz4_available() noexcept {
+#ifdef EXPORT_TO_WKT_WITH_LZ4
+    return true;
+#else
+    return false;
+#endif
+}
+
+// Suffix for output files (after ".wkt")
+inline const char* compression_suffix(compression_type compression) noexcept {
+    switch (compression) {
+        case compression_type::gzip:
+            return ".gz";
+        case compression_type::lz4:
+            return ".lz4";
+        default:
+            break;
+    }
+    return "";
+}
+
+inline std::string gzip_compress(const std::string& data) {
+    z_stream stream{};
+    // window bits + 16: write gzip header and trailer
+    if (deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        throw std::runtime_error{"gzip compression failed"};
+    }
+
+    std::string out(deflateBound(&stream, static_cast<uLong>(data.size())), '\0');
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+    stream.avail_in = static_cast<uInt>(data.size());
+    stream.next_out = reinterpret_cast<Bytef*>(&out[0]);
+    stream.avail_out = static_cast<uInt>(out.size());
+
+    const int result = deflate(&stream, Z_FINISH);
+    deflateEnd(&stream);
+    if (result != Z_STREAM_END) {
+        throw std::runtime_error{"gzip compression failed"};
+    }
+
+    out.resize(stream.total_out);
+    return out;
+}
+
+#ifdef EXPORT_TO_WKT_WITH_LZ4
+inline std::string lz4_compress(const std::string& data) {
+    std::string out(LZ4F_compressFrameBound(data.size(), nullptr), '\0');
+    const std::size_t size = LZ4F_compressFrame(&out[0], out.size(), data.data(), data.size(), nullptr);
+    if (LZ4F_isError(size)) {
+        throw std::runtime_error{std::string{"lz4 compression failed: "} + LZ4F_getErrorName(size)};
+    }
+    out.resize(size);
+    return out;
+}
+#endif
+
+inline std::string compress(compression_type compression, const std::string& data) {
+    switch (compression) {
+        case compression_type::gzip:
+            return gzip_compress(data);
+#ifdef EXPORT_TO_WKT_WITH_LZ4
+        case compression_type::lz4:
+            return lz4_compress(data);
+#endif
+        default:
+            break;
+    }
+    return data;
+}
+
+#endif // COMPRESSION_HPP
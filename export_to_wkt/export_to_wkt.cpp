@@ -1,14 +1,24 @@
 
 // The code in this file is released into the Public Domain.
 
+#include <cstdint>
+#include <exception>
+#include <filesystem>
+#include <functional>
 #include <iostream>
+#include <memory>
+#include <stdexcept>
 #include <string>
+#include <system_error>
+#include <vector>
 
 #include <osmium/area/assembler.hpp>
-#include <osmium/area/multipolygon_manager.hpp>
 #include <osmium/geom/wkt.hpp>
 #include <osmium/handler.hpp>
+#include <osmium/index/id_set.hpp>
 #include <osmium/io/any_input.hpp>
+#include <osmium/tags/taglist.hpp>
+#include <osmium/util/memory.hpp>
 #include <osmium/visitor.hpp>
 
 #include <osmium/index/map/flex_mem.hpp>
@@ -16,58 +26,422 @@
 using index_type = osmium::index::map::FlexMem<osmium::unsigned_object_id_type, osmium::Location>;
 using location_handler_type = osmium::handler::NodeLocationsForWays<index_type>;
 
+using id_set_type = osmium::index::IdSetDense<osmium::unsigned_object_id_type>;
+
+#include "cmdline_options.hpp"
+#include "incremental.hpp"
+#include "multipolygon_batches.hpp"
+#include "output.hpp"
+#include "parallel_multipolygon_manager.hpp"
+#include "run_stats.hpp"
+
+using mp_manager_type = ParallelMultipolygonManager<osmium::area::Assembler>;
+
 class ExportToWKTHandler : public osmium::handler::Handler {
 
+    const Options& m_options;
+    Output& m_output;
+
     osmium::geom::WKTFactory<> m_factory;
 
+    uint64_t m_points = 0;
+    uint64_t m_linestrings = 0;
+    uint64_t m_multipolygons = 0;
+
 public:
 
-    void node(const osmium::Node& node) {
-        std::cout << 'n' << node.id() << ' ' << m_factory.create_point(node) << "\n";
+    ExportToWKTHandler(const Options& options, Output& output) :
+        m_options(options),
+        m_output(output) {
     }
 
-    void way(const osmium::Way& way) {
+    // The handler functions return whether a geometry was written. This
+    // is used for incremental updates.
+
+    bool node(const osmium::Node& node) {
+        if (m_options.filtering() && !osmium::tags::match_any_of(node.tags(), std::cref(m_options.node_filter))) {
+            return false;
+        }
+        m_output.add('n', node.id(), node.location(), m_factory.create_point(node));
+        ++m_points;
+        return true;
+    }
+
+    bool way(const osmium::Way& way) {
+        if (m_options.filtering() && !osmium::tags::match_any_of(way.tags(), std::cref(m_options.way_filter))) {
+            return false;
+        }
         try {
-            std::cout << 'w' << way.id() << ' ' << m_factory.create_linestring(way) << "\n";
+            const std::string wkt{m_factory.create_linestring(way)};
+            m_output.add('w', way.id(), way.nodes().front().location(), wkt);
+            ++m_linestrings;
+            return true;
         } catch (const osmium::geometry_error&) {
             // ignore broken geometries (such as ways with only a single node)
+        } catch (const osmium::invalid_location&) {
+            // ignore ways with missing node locations
         }
+        return false;
     }
 
-    void area(const osmium::Area& area) {
+    bool area(const osmium::Area& area) {
         try {
-            std::cout << 'a' << area.id() << ' ' << m_factory.create_multipolygon(area) << "\n";
+            const std::string wkt{m_factory.create_multipolygon(area)};
+            m_output.add('a', area.id(), area.cbegin<osmium::OuterRing>()->front().location(), wkt);
+            ++m_multipolygons;
+            return true;
         } catch (const osmium::geometry_error&) {
             // ignore broken geometries (such as illegal multipolygons)
         }
+        return false;
+    }
+
+    void add_counters(RunStats& stats) const {
+        stats.add("points", m_points);
+        stats.add("linestrings", m_linestrings);
+        stats.add("multipolygons", m_multipolygons);
     }
 
 }; // class ExportToWKTHandler
 
+/**
+ * Remembers the member ways of all multipolygon relations the
+ * multipolygon manager is interested in. Use together with the
+ * manager in osmium::relations::read_relations().
+ */
+class MemberWaysCollector : public osmium::handler::Handler {
+
+    const Options& m_options;
+    id_set_type& m_way_ids;
+
+public:
+
+    MemberWaysCollector(const Options& options, id_set_type& way_ids) :
+        m_options(options),
+        m_way_ids(way_ids) {
+    }
+
+    void relation(const osmium::Relation& relation) {
+        if (!is_wanted_multipolygon(m_options, relation)) {
+            return;
+        }
+        for (const auto& member : relation.members()) {
+            if (member.type() == osmium::item_type::way) {
+                m_way_ids.set(member.positive_ref());
+            }
+        }
+    }
+
+    void prepare_for_lookup() const noexcept {
+    }
+
+}; // class MemberWaysCollector
+
+/**
+ * Remembers all nodes referenced by ways. If filtering, only ways that
+ * will end up in the output either as linestring or as (part of) an area
+ * are taken into account.
+ */
+class WayNodesCollector : public osmium::handler::Handler {
+
+    const Options& m_options;
+    const id_set_type& m_member_way_ids;
+    id_set_type& m_node_ids;
+
+public:
+
+    WayNodesCollector(const Options& options, const id_set_type& member_way_ids, id_set_type& node_ids) :
+        m_options(options),
+        m_member_way_ids(member_way_ids),
+        m_node_ids(node_ids) {
+    }
+
+    void way(const osmium::Way& way) {
+        if (m_options.filtering() &&
+            !osmium::tags::match_any_of(way.tags(), std::cref(m_options.way_filter)) &&
+            !(way.is_closed() && osmium::tags::match_any_of(way.tags(), std::cref(m_options.area_filter))) &&
+            !m_member_way_ids.get(way.positive_id())) {
+            return;
+        }
+        for (const auto& node_ref : way.nodes()) {
+            m_node_ids.set(node_ref.positive_ref());
+        }
+    }
+
+}; // class WayNodesCollector
+
+/**
+ * Like the NodeLocationsForWays handler, but only stores locations of
+ * nodes in the given id set.
+ */
+class SelectedNodeLocationsForWays : public osmium::handler::Handler {
+
+    location_handler_type& m_location_handler;
+    const id_set_type& m_node_ids;
+
+public:
+
+    SelectedNodeLocationsForWays(location_handler_type& location_handler, const id_set_type& node_ids) :
+        m_location_handler(location_handler),
+        m_node_ids(node_ids) {
+    }
+
+    void node(const osmium::Node& node) {
+        if (m_node_ids.get(node.positive_id())) {
+            m_location_handler.node(node);
+        }
+    }
+
+    void way(osmium::Way& way) {
+        m_location_handler.way(way);
+    }
+
+}; // class SelectedNodeLocationsForWays
+
+void write_stats(const Options& options, const RunStats& stats) {
+    osmium::MemoryUsage memory;
+    if (memory.peak()) {
+        options.vout << "Peak memory used: " << memory.peak() << " MBytes\n";
+    }
+
+    if (!options.stats_filename.empty()) {
+        try {
+            stats.write_json(options.stats_filename);
+        } catch (const std::runtime_error& e) {
+            std::cerr << e.what() << "\n";
+            std::exit(return_code::error);
+        }
+    }
+}
+
+std::unique_ptr<Output> create_output(const Options& options) {
+    try {
+        if (options.output_directory.empty()) {
+            return std::make_unique<Output>(options.compression, options.compression_threads);
+        }
+        std::filesystem::create_directories(options.output_directory);
+        return std::make_unique<Output>(options.output_directory, options.partitions, options.compression, options.compression_threads);
+    } catch (const std::exception& e) {
+        std::cerr << "Error creating output: " << e.what() << "\n";
+        std::exit(return_code::fatal);
+    }
+}
+
+StateWriter create_state_writer(const Options& options) {
+    try {
+        if (!options.state_directory.empty()) {
+            std::filesystem::create_directories(options.state_directory);
+        }
+        return StateWriter{options.state_directory};
+    } catch (const std::exception& e) {
+        std::cerr << "Error creating state: " << e.what() << "\n";
+        std::exit(return_code::fatal);
+    }
+}
+
+/**
+ * Apply the change file given as input to the state from an earlier run
+ * and write out the changed geometries.
+ */
+void update(const Options& options, RunStats& stats) {
+    const osmium::io::File change_file{options.input_filename, options.input_format};
+
+    std::unique_ptr<Output> output{create_output(options)};
+    ExportToWKTHandler export_handler{options, *output};
+
+    options.vout << "Applying changes to state in '" << options.state_directory << "'...\n";
+    try {
+        const auto phase = stats.phase("apply_changes");
+        IncrementalUpdate<ExportToWKTHandler> incremental_update{options, export_handler, *output};
+        incremental_update.apply(change_file);
+        stats.add("deleted", incremental_update.deleted_geometries());
+        options.vout << "Done. " << incremental_update.deleted_geometries() << " geometries deleted.\n";
+    } catch (const std::system_error& e) {
+        std::cerr << "Error updating state: " << e.what() << "\n";
+        std::exit(return_code::fatal);
+    }
+
+    try {
+        const auto phase = stats.phase("close_output");
+        output->close();
+    } catch (const std::exception& e) {
+        std::cerr << "Error writing output: " << e.what() << "\n";
+        std::exit(return_code::error);
+    }
+
+    export_handler.add_counters(stats);
+}
+
 int main(int argc, char* argv[]) {
-    if (argc != 2) {
-        std::cerr << "Usage: " << argv[0] << " OSMFILE\n";
-        std::exit(1);
+    Options options{argc, argv};
+
+    if (options.input_filename == "-" && options.input_format.empty()) {
+        std::cerr << "When reading from STDIN you have to give the input format with --format, -f.\n";
+        std::exit(return_code::fatal);
+    }
+
+    options.vout << "Options from command line or defaults:\n";
+    options.vout << "  Input file:               " << options.input_filename << "\n";
+    if (!options.input_format.empty()) {
+        options.vout << "  Input format:             " << options.input_format << "\n";
+    }
+    if (options.output_directory.empty()) {
+        options.vout << "  Output:                   STDOUT\n";
+    } else {
+        options.vout << "  Output directory:         " << options.output_directory << "\n";
+        options.vout << "  Partitions:               " << options.partitions << "\n";
+    }
+    if (options.compression != compression_type::none) {
+        options.vout << "  Compression:              " << (options.compression == compression_type::gzip ? "gzip" : "lz4") << "\n";
+    }
+    for (const auto& expression : options.filter_expressions) {
+        options.vout << "  Filter expression:        " << expression << "\n";
+    }
+    options.vout << "  Way nodes only:           " << (options.way_nodes_only ? "yes" : "no") << "\n";
+    if (options.max_mp_members > 0) {
+        options.vout << "  Max multipolygon members: " << options.max_mp_members << "\n";
+    }
+    options.vout << "  Assembler threads:        " << options.assembler_threads << "\n";
+    if (!options.state_directory.empty()) {
+        options.vout << "  State directory:          " << options.state_directory << "\n";
+        options.vout << "  Update:                   " << (options.update ? "yes" : "no") << "\n";
     }
 
-    const osmium::io::File input_file{argv[1]};
+    RunStats stats{"export_to_wkt"};
+
+    if (options.update) {
+        update(options, stats);
+        write_stats(options, stats);
+        return return_code::okay;
+    }
+
+    const osmium::io::File input_file{options.input_filename, options.input_format};
 
     osmium::area::Assembler::config_type assembler_config;
-    osmium::area::MultipolygonManager<osmium::area::Assembler> mp_manager{assembler_config};
+    const osmium::TagsFilter mp_filter{options.filtering() ? options.area_filter : osmium::TagsFilter{true}};
+    mp_manager_type mp_manager{assembler_config, mp_filter, options.assembler_threads};
+
+    id_set_type member_way_ids;
+    MemberWaysCollector member_ways_collector{options, member_way_ids};
+
+    std::vector<IdRange> batches;
+    if (options.max_mp_members > 0) {
+        options.vout << "Counting multipolygon relations...\n";
+        const auto phase = stats.phase("count_relations");
+        MultipolygonBatcher batcher{options};
+        osmium::io::Reader reader{input_file, osmium::osm_entity_bits::relation, osmium::io::read_meta::no};
+        if (options.filtering()) {
+            osmium::apply(reader, batcher, member_ways_collector);
+        } else {
+            osmium::apply(reader, batcher);
+        }
+        reader.close();
+        batches = batcher.batches(options.max_mp_members);
+        options.vout << "Done. Assembling multipolygons in " << batches.size() << " batch(es).\n";
+    }
 
-    std::cerr << "Pass 1...\n";
-    osmium::relations::read_relations(input_file, mp_manager);
-    std::cerr << "Pass 1 done\n";
+    options.vout << "Reading relations...\n";
+    {
+        const auto phase = stats.phase("read_relations");
+        if (batches.size() > 1) {
+            BatchRelations<mp_manager_type> first_batch{options, batches.front(), mp_manager};
+            osmium::relations::read_relations(input_file, first_batch);
+        } else if (options.filtering()) {
+            osmium::relations::read_relations(input_file, mp_manager, member_ways_collector);
+        } else {
+            osmium::relations::read_relations(input_file, mp_manager);
+        }
+    }
+    options.vout << "Done.\n";
+
+    // Only the locations of nodes referenced by ways (when filtering only
+    // by matching ways or by member ways of matching relations) are needed.
+    // They are remembered in a bitmap with one bit per node id, which is
+    // much smaller than the location index for all nodes.
+    id_set_type way_node_ids;
+    if (options.select_way_nodes()) {
+        options.vout << "Collecting nodes referenced by ways...\n";
+        const auto phase = stats.phase("collect_way_nodes");
+        WayNodesCollector way_nodes_collector{options, member_way_ids, way_node_ids};
+        osmium::io::Reader reader{input_file, osmium::osm_entity_bits::way, osmium::io::read_meta::no};
+        osmium::apply(reader, way_nodes_collector);
+        reader.close();
+        options.vout << "Done. Need locations of " << way_node_ids.size() << " nodes ("
+                     << (way_node_ids.used_memory() / (1024 * 1024)) << " MBytes for id set).\n";
+    }
 
     index_type index;
-    location_handler_type location_handler(index);
+    location_handler_type location_handler{index};
+
+    std::unique_ptr<Output> output{create_output(options)};
 
-    std::cerr << "Pass 2...\n";
-    ExportToWKTHandler export_handler;
+    StateWriter state_writer{create_state_writer(options)};
+    if (!options.state_directory.empty()) {
+        options.vout << "Writing state for incremental updates to '" << options.state_directory << "'.\n";
+    }
+
+    options.vout << "Creating geometries...\n";
+    auto geometries_phase = stats.phase("create_geometries");
+    ExportToWKTHandler export_handler{options, *output};
     osmium::io::Reader reader{input_file};
-    osmium::apply(reader, location_handler, export_handler, mp_manager.handler([&export_handler](const osmium::memory::Buffer& buffer) {
+    auto area_handler = mp_manager.handler([&export_handler](const osmium::memory::Buffer& buffer) {
         osmium::apply(buffer, export_handler);
-    }));
-    std::cerr << "Pass 2 done\n";
+    });
+    if (options.select_way_nodes()) {
+        // Ways we don't need for the output will have missing node locations.
+        location_handler.ignore_errors();
+        SelectedNodeLocationsForWays selected_location_handler{location_handler, way_node_ids};
+        osmium::apply(reader, selected_location_handler, state_writer, export_handler, area_handler);
+    } else {
+        osmium::apply(reader, location_handler, state_writer, export_handler, area_handler);
+    }
+    reader.close();
+    state_writer.close();
+    mp_manager.finish();
+    geometries_phase.stop();
+    options.vout << "Done.\n";
+
+    // All multipolygon batches but the first need an extra pass over the
+    // relations and the ways. The node locations are already in the index.
+    for (std::size_t i = 1; i < batches.size(); ++i) {
+        options.vout << "Assembling multipolygons (batch " << (i + 1) << " of " << batches.size() << ")...\n";
+        const auto phase = stats.phase("assemble_batch");
+        mp_manager_type batch_manager{assembler_config, mp_filter, options.assembler_threads};
+        BatchRelations<mp_manager_type> batch_relations{options, batches[i], batch_manager};
+        osmium::relations::read_relations(input_file, batch_relations);
+
+        auto batch_area_handler = batch_manager.handler([&export_handler](const osmium::memory::Buffer& buffer) {
+            for (auto it = buffer.cbegin<osmium::Area>(); it != buffer.cend<osmium::Area>(); ++it) {
+                // Areas from closed ways have been created with the first batch.
+                if (!it->from_way()) {
+                    export_handler.area(*it);
+                }
+            }
+        });
+        BatchMemberWays<BatchRelations<mp_manager_type>, location_handler_type, decltype(batch_area_handler)>
+            batch_member_ways{batch_relations, location_handler, batch_area_handler};
+
+        osmium::io::Reader way_reader{input_file, osmium::osm_entity_bits::way, osmium::io::read_meta::no};
+        osmium::apply(way_reader, batch_member_ways);
+        way_reader.close();
+        batch_manager.finish();
+        options.vout << "Done.\n";
+    }
+
+    try {
+        const auto phase = stats.phase("close_output");
+        output->close();
+    } catch (const std::exception& e) {
+        std::cerr << "Error writing output: " << e.what() << "\n";
+        std::exit(return_code::error);
+    }
+
+    export_handler.add_counters(stats);
+
+    options.vout << "Location index needs " << (index.used_memory() / (1024 * 1024)) << " MBytes.\n";
+
+    write_stats(options, stats);
+
+    return return_code::okay;
 }
 
@@ -0,0 +1,508 @@
+#ifndef INCREMENTAL_HPP
+#define INCREMENTAL_HPP
+
+// The code in this file is released into the Public Domain.
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+
+#include <osmium/area/assembler.hpp>
+#include <osmium/handler.hpp>
+#include <osmium/index/id_set.hpp>
+#include <osmium/index/map/dense_file_array.hpp>
+#include <osmium/io/any_input.hpp>
+#include <osmium/io/any_output.hpp>
+#include <osmium/memory/buffer.hpp>
+#include <osmium/object_pointer_collection.hpp>
+#include <osmium/osm/area.hpp>
+#include <osmium/osm/location.hpp>
+#include <osmium/osm/node.hpp>
+#include <osmium/osm/object_comparisons.hpp>
+#include <osmium/osm/relation.hpp>
+#include <osmium/osm/types.hpp>
+#include <osmium/osm/way.hpp>
+#include <osmium/tags/taglist.hpp>
+#include <osmium/visitor.hpp>
+
+#include "cmdline_options.hpp"
+#include "multipolygon_batches.hpp"
+#include "output.hpp"
+
+/**
+ * The state needed for incremental updates is kept in a directory: The
+ * locations of all nodes in a file-backed array indexed by node id, and
+ * all ways and relations in PBF files sorted by id.
+ */
+struct StateFiles {
+
+    using location_index_type = osmium::index::map::DenseFileArray<osmium::unsigned_object_id_type, osmium::Location>;
+
+    std::string locations;
+    std::string ways;
+    std::string relations;
+
+    explicit StateFiles(const std::string& directory) :
+        locations(directory + "/locations.dat"),
+        ways(directory + "/ways.osm.pbf"),
+        relations(directory + "/relations.osm.pbf") {
+    }
+
+    // New versions of the PBF files are written under this name first and
+    // renamed when done.
+    static std::string tmp_name(const std::string& filename) {
+        return filename.substr(0, filename.size() - 8) + ".new.osm.pbf";
+    }
+
+    // Replace the file with its new version.
+    static void replace(const std::string& filename) {
+        const std::string new_filename{tmp_name(filename)};
+        if (std::rename(new_filename.c_str(), filename.c_str()) != 0) {
+            throw std::system_error{errno, std::system_category(), "Can not rename '" + new_filename + "' to '" + filename + "'"};
+        }
+    }
+
+    static int open_location_file(const std::string& filename, bool create) {
+        const int fd = ::open(filename.c_str(), O_RDWR | (create ? (O_CREAT | O_TRUNC) : 0), 0644); // NOLINT(hicpp-signed-bitwise)
+        if (fd < 0) {
+            throw std::system_error{errno, std::system_category(), "Can not open '" + filename + "'"};
+        }
+        return fd;
+    }
+
+}; // struct StateFiles
+
+/**
+ * Writes an OSM file from buffers filled with copies of the objects.
+ */
+class ObjectFileWriter {
+
+    static constexpr const std::size_t buffer_size = 10UL * 1024UL * 1024UL;
+
+    osmium::io::Writer m_writer;
+    osmium::memory::Buffer m_buffer{buffer_size, osmium::memory::Buffer::auto_grow::yes};
+
+public:
+
+    explicit ObjectFileWriter(const std::string& filename) :
+        m_writer(filename, osmium::io::overwrite::allow) {
+    }
+
+    void add(const osmium::OSMObject& object) {
+        m_buffer.add_item(object);
+        m_buffer.commit();
+        if (m_buffer.committed() > buffer_size - 1024UL * 1024UL) {
+            m_writer(std::move(m_buffer));
+            m_buffer = osmium::memory::Buffer{buffer_size, osmium::memory::Buffer::auto_grow::yes};
+        }
+    }
+
+    void close() {
+        m_writer(std::move(m_buffer));
+        m_writer.close();
+    }
+
+}; // class ObjectFileWriter
+
+/**
+ * Handler writing the state for incremental updates in a full run. Use
+ * it in the pass over the whole input file. Does nothing if the state
+ * directory is empty.
+ */
+class StateWriter : public osmium::handler::Handler {
+
+    std::unique_ptr<StateFiles> m_files;
+    std::unique_ptr<StateFiles::location_index_type> m_locations;
+    std::unique_ptr<ObjectFileWriter> m_ways;
+    std::unique_ptr<ObjectFileWriter> m_relations;
+
+public:
+
+    explicit StateWriter(const std::string& directory) {
+        if (directory.empty()) {
+            return;
+        }
+        m_files = std::make_unique<StateFiles>(directory);
+        m_locations = std::make_unique<StateFiles::location_index_type>(StateFiles::open_location_file(m_files->locations, true));
+        m_ways = std::make_unique<ObjectFileWriter>(m_files->ways);
+        m_relations = std::make_unique<ObjectFileWriter>(m_files->relations);
+    }
+
+    void node(const osmium::Node& node) {
+        if (m_locations) {
+            m_locations->set(node.positive_id(), node.location());
+        }
+    }
+
+    void way(const osmium::Way& way) {
+        if (m_ways) {
+            m_ways->add(way);
+        }
+    }
+
+    void relation(const osmium::Relation& relation) {
+        if (m_relations) {
+            m_relations->add(relation);
+        }
+    }
+
+    void close() {
+        if (m_ways) {
+            m_ways->close();
+            m_relations->close();
+        }
+    }
+
+}; // class StateWriter
+
+/**
+ * Applies a change file to the state written by StateWriter and writes
+ * out all geometries that changed: Those of the nodes, ways, and relations
+ * in the change file, and those of all ways with nodes that changed and of
+ * all multipolygon relations with member ways that changed. Geometries of
+ * deleted objects (or objects not exported any more) are written as
+ * "GEOMETRYCOLLECTION EMPTY".
+ *
+ * Deletions are only written for objects which might have been exported
+ * before: For objects in the change file (their tags might have changed)
+ * and for objects whose geometry could have become invalid. Objects which
+ * are not in the change file keep their node ids and tags, so an unchanged
+ * way that is not closed never was an area.
+ *
+ * The export handler is used to create the geometries, its functions must
+ * return whether they exported the object.
+ */
+template <typename TExportHandler>
+class IncrementalUpdate {
+
+    using id_set_type = osmium::index::IdSetDense<osmium::unsigned_object_id_type>;
+
+    static constexpr const char* deleted = "GEOMETRYCOLLECTION EMPTY";
+
+    const Options& m_options;
+    TExportHandler& m_export_handler;
+    Output& m_output;
+    StateFiles m_files;
+    const osmium::TagsFilter m_area_filter;
+
+    StateFiles::location_index_type m_locations;
+
+    // The newest version of all objects in the change file by id
+    std::map<osmium::object_id_type, osmium::Way*> m_changed_ways;
+    std::map<osmium::object_id_type, const osmium::Relation*> m_changed_relations;
+
+    id_set_type m_changed_nodes;
+    id_set_type m_changed_ways_set;
+
+    // Relations to be assembled and their member ways
+    osmium::memory::Buffer m_mp_relations{1024UL * 1024UL, osmium::memory::Buffer::auto_grow::yes};
+    id_set_type m_member_ways;
+
+    uint64_t m_deleted_geometries = 0;
+
+    void write_deleted(char type, osmium::object_id_type id) {
+        m_output.add(type, id, osmium::Location{}, deleted);
+        ++m_deleted_geometries;
+    }
+
+    void set_locations(osmium::Way& way) {
+        for (auto& node_ref : way.nodes()) {
+            node_ref.set_location(m_locations.get_noexcept(node_ref.positive_ref()));
+        }
+    }
+
+    void update_node(const osmium::Node& node) {
+        m_changed_nodes.set(node.positive_id());
+        if (!node.visible()) {
+            m_locations.set(node.positive_id(), osmium::Location{});
+            write_deleted('n', node.id());
+            return;
+        }
+        m_locations.set(node.positive_id(), node.location());
+        if (!m_export_handler.node(node)) {
+            write_deleted('n', node.id());
+        }
+    }
+
+    bool matches_way_filter(const osmium::Way& way) const {
+        return !m_options.filtering() || osmium::tags::match_any_of(way.tags(), std::cref(m_options.way_filter));
+    }
+
+    // Could the way be an area? This only depends on the node ids and the
+    // tags. (Same rules as in the ParallelMultipolygonManager.)
+    bool area_candidate(const osmium::Way& way) const {
+        return way.nodes().size() > 3 &&
+               way.is_closed() &&
+               !way.tags().has_tag("area", "no") &&
+               osmium::tags::match_any_of(way.tags(), std::cref(m_area_filter));
+    }
+
+    bool update_way_area(const osmium::Way& way) {
+        if (!area_candidate(way) ||
+            !way.nodes().front().location() ||
+            !way.ends_have_same_location()) {
+            return false;
+        }
+
+        osmium::memory::Buffer buffer{1024, osmium::memory::Buffer::auto_grow::yes};
+        try {
+            osmium::area::Assembler assembler{osmium::area::Assembler::config_type{}};
+            assembler(way, buffer);
+        } catch (const osmium::invalid_location&) {
+            return false;
+        }
+
+        bool exported = false;
+        for (const auto& area : buffer.select<osmium::Area>()) {
+            exported = m_export_handler.area(area) || exported;
+        }
+        return exported;
+    }
+
+    void update_way(osmium::Way& way, bool in_change_file) {
+        m_changed_ways_set.set(way.positive_id());
+        set_locations(way);
+
+        if (!m_export_handler.way(way) && (in_change_file || matches_way_filter(way))) {
+            write_deleted('w', way.id());
+        }
+
+        if (!update_way_area(way) && (in_change_file || area_candidate(way))) {
+            write_deleted('a', osmium::object_id_to_area_id(way.id(), osmium::item_type::way));
+        }
+    }
+
+    // Merge the ways in the state file with the changed ways, write the
+    // result into a new state file and update the geometries of all ways
+    // that changed or have nodes that changed.
+    void update_ways() {
+        ObjectFileWriter writer{StateFiles::tmp_name(m_files.ways)};
+        auto changed = m_changed_ways.begin();
+
+        const auto handle_changed = [&](osmium::Way& way) {
+            if (way.visible()) {
+                writer.add(way);
+                update_way(way, true);
+            } else {
+                m_changed_ways_set.set(way.positive_id());
+                write_deleted('w', way.id());
+                write_deleted('a', osmium::object_id_to_area_id(way.id(), osmium::item_type::way));
+            }
+        };
+
+        osmium::io::Reader reader{m_files.ways, osmium::osm_entity_bits::way, osmium::io::read_meta::no};
+        while (osmium::memory::Buffer buffer = reader.read()) {
+            for (auto& way : buffer.select<osmium::Way>()) {
+                for (; changed != m_changed_ways.end() && changed->first < way.id(); ++changed) {
+                    handle_changed(*changed->second);
+                }
+                if (changed != m_changed_ways.end() && changed->first == way.id()) {
+                    handle_changed(*changed->second);
+                    ++changed;
+                    continue;
+                }
+                writer.add(way);
+                if (std::any_of(way.nodes().cbegin(), way.nodes().cend(), [this](const osmium::NodeRef& node_ref) {
+                        return m_changed_nodes.get(node_ref.positive_ref());
+                    })) {
+                    update_way(way, false);
+                }
+            }
+        }
+        reader.close();
+
+        for (; changed != m_changed_ways.end(); ++changed) {
+            handle_changed(*changed->second);
+        }
+        writer.close();
+    }
+
+    void update_relation(const osmium::Relation& relation, bool in_change_file) {
+        const bool has_way_members = std::any_of(relation.members().cbegin(), relation.members().cend(), [](const osmium::RelationMember& member) {
+            return member.type() == osmium::item_type::way;
+        });
+        if (!has_way_members || !is_wanted_multipolygon(m_options, relation)) {
+            if (in_change_file) {
+                write_deleted('a', osmium::object_id_to_area_id(relation.id(), osmium::item_type::relation));
+            }
+            return;
+        }
+
+        // Assembled later when we have all member ways
+        m_mp_relations.add_item(relation);
+        m_mp_relations.commit();
+        for (const auto& member : relation.members()) {
+            if (member.type() == osmium::item_type::way) {
+                m_member_ways.set(member.positive_ref());
+            }
+        }
+    }
+
+    // Like update_ways() for relations.
+    void update_relations() {
+        ObjectFileWriter writer{StateFiles::tmp_name(m_files.relations)};
+        auto changed = m_changed_relations.begin();
+
+        const auto handle_changed = [&](const osmium::Relation& relation) {
+            if (relation.visible()) {
+                writer.add(relation);
+                update_relation(relation, true);
+            } else {
+                write_deleted('a', osmium::object_id_to_area_id(relation.id(), osmium::item_type::relation));
+            }
+        };
+
+        osmium::io::Reader reader{m_files.relations, osmium::osm_entity_bits::relation, osmium::io::read_meta::no};
+        while (osmium::memory::Buffer buffer = reader.read()) {
+            for (const auto& relation : buffer.select<osmium::Relation>()) {
+                for (; changed != m_changed_relations.end() && changed->first < relation.id(); ++changed) {
+                    handle_changed(*changed->second);
+                }
+                if (changed != m_changed_relations.end() && changed->first == relation.id()) {
+                    handle_changed(*changed->second);
+                    ++changed;
+                    continue;
+                }
+                writer.add(relation);
+                if (std::any_of(relation.members().cbegin(), relation.members().cend(), [this](const osmium::RelationMember& member) {
+                        return member.type() == osmium::item_type::way && m_changed_ways_set.get(member.positive_ref());
+                    })) {
+                    update_relation(relation, false);
+                }
+            }
+        }
+        reader.close();
+
+        for (; changed != m_changed_relations.end(); ++changed) {
+            handle_changed(*changed->second);
+        }
+        writer.close();
+    }
+
+    // Read the member ways of all relations to be assembled from the
+    // (new) ways state file and assemble the relations.
+    void assemble_relations() {
+        if (m_mp_relations.committed() == 0) {
+            return;
+        }
+
+        osmium::memory::Buffer ways{1024UL * 1024UL, osmium::memory::Buffer::auto_grow::yes};
+        osmium::io::Reader reader{StateFiles::tmp_name(m_files.ways), osmium::osm_entity_bits::way, osmium::io::read_meta::no};
+        while (osmium::memory::Buffer buffer = reader.read()) {
+            for (const auto& way : buffer.select<osmium::Way>()) {
+                if (m_member_ways.get(way.positive_id())) {
+                    ways.add_item(way);
+                    ways.commit();
+                }
+            }
+        }
+        reader.close();
+
+        std::map<osmium::object_id_type, const osmium::Way*> way_by_id;
+        for (auto& way : ways.select<osmium::Way>()) {
+            set_locations(way);
+            way_by_id.emplace(way.id(), &way);
+        }
+
+        for (const auto& relation : m_mp_relations.select<osmium::Relation>()) {
+            std::vector<const osmium::Way*> members;
+            bool complete = true;
+            for (const auto& member : relation.members()) {
+                if (member.type() != osmium::item_type::way) {
+                    continue;
+                }
+                const auto it = way_by_id.find(member.ref());
+                if (it == way_by_id.end()) {
+                    complete = false;
+                    break;
+                }
+                members.push_back(it->second);
+            }
+
+            bool exported = false;
+            if (complete) {
+                osmium::memory::Buffer buffer{1024, osmium::memory::Buffer::auto_grow::yes};
+                try {
+                    osmium::area::Assembler assembler{osmium::area::Assembler::config_type{}};
+                    assembler(relation, members, buffer);
+                } catch (const osmium::invalid_location&) {
+                    buffer.clear();
+                }
+                for (const auto& area : buffer.select<osmium::Area>()) {
+                    exported = m_export_handler.area(area) || exported;
+                }
+            }
+            if (!exported) {
+                write_deleted('a', osmium::object_id_to_area_id(relation.id(), osmium::item_type::relation));
+            }
+        }
+    }
+
+public:
+
+    IncrementalUpdate(const Options& options, TExportHandler& export_handler, Output& output) :
+        m_options(options),
+        m_export_handler(export_handler),
+        m_output(output),
+        m_files(options.state_directory),
+        m_area_filter(options.filtering() ? options.area_filter : osmium::TagsFilter{true}),
+        m_locations(StateFiles::open_location_file(m_files.locations, false)) {
+    }
+
+    /**
+     * Apply the change file and write out all changed geometries. The node
+     * locations are updated in place, the way and relation files are
+     * replaced at the end. Applying the same change file again gives the
+     * same state, so if this fails, it can simply be run again with the
+     * same change file.
+     */
+    void apply(const osmium::io::File& change_file) {
+        osmium::memory::Buffer changes = osmium::io::read_file(change_file);
+
+        // Only the newest version of each object is used
+        osmium::ObjectPointerCollection objects;
+        osmium::apply(changes, objects);
+        objects.sort(osmium::object_order_type_id_reverse_version{});
+        objects.unique(osmium::object_equal_type_id{});
+
+        for (auto& object : objects) {
+            switch (object.type()) {
+                case osmium::item_type::node:
+                    update_node(static_cast<const osmium::Node&>(object));
+                    break;
+                case osmium::item_type::way:
+                    m_changed_ways.emplace(object.id(), &static_cast<osmium::Way&>(object));
+                    break;
+                case osmium::item_type::relation:
+                    m_changed_relations.emplace(object.id(), &static_cast<const osmium::Relation&>(object));
+                    break;
+                default:
+                    break;
+            }
+        }
+
+        update_ways();
+        update_relations();
+        assemble_relations();
+
+        StateFiles::replace(m_files.ways);
+        StateFiles::replace(m_files.relations);
+    }
+
+    uint64_t deleted_geometries() const noexcept {
+        return m_deleted_geometries;
+    }
+
+}; // class IncrementalUpdate
+
+#endif // INCREMENTAL_HPP
@@ -0,0 +1,170 @@
+#ifndef MULTIPOLYGON_BATCHES_HPP
+#define MULTIPOLYGON_BATCHES_HPP
+
+// The code in this file is released into the Public Domain.
+
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <utility>
+#include <vector>
+
+#include <osmium/handler.hpp>
+#include <osmium/osm/relation.hpp>
+#include <osmium/osm/types.hpp>
+#include <osmium/osm/way.hpp>
+#include <osmium/tags/taglist.hpp>
+
+#include "cmdline_options.hpp"
+
+/**
+ * Is this a relation the multipolygon manager will assemble?
+ */
+inline bool is_wanted_multipolygon(const Options& options, const osmium::Relation& relation) {
+    const char* type = relation.tags()["type"];
+    if (!type || (std::strcmp(type, "multipolygon") && std::strcmp(type, "boundary"))) {
+        return false;
+    }
+    return !options.filtering() ||
+           osmium::tags::match_any_of(relation.tags(), std::cref(options.area_filter));
+}
+
+struct IdRange {
+
+    osmium::object_id_type first;
+    osmium::object_id_type last;
+
+    bool contains(osmium::object_id_type id) const noexcept {
+        return id >= first && id <= last;
+    }
+
+}; // struct IdRange
+
+/**
+ * Splits the multipolygon relations into batches of relations with
+ * consecutive ids so that each batch has at most max_members member
+ * ways (unless a single relation has more than that). Only one batch
+ * is assembled at a time, so this bounds the number of member ways the
+ * multipolygon manager has to keep in memory.
+ */
+class MultipolygonBatcher : public osmium::handler::Handler {
+
+    const Options& m_options;
+
+    // relation id and number of way members
+    std::vector<std::pair<osmium::object_id_type, std::size_t>> m_relations;
+
+public:
+
+    explicit MultipolygonBatcher(const Options& options) :
+        m_options(options) {
+    }
+
+    void relation(const osmium::Relation& relation) {
+        if (!is_wanted_multipolygon(m_options, relation)) {
+            return;
+        }
+        const auto num_ways = std::count_if(relation.members().cbegin(), relation.members().cend(), [](const osmium::RelationMember& member) {
+            return member.type() == osmium::item_type::way;
+        });
+        m_relations.emplace_back(relation.id(), static_cast<std::size_t>(num_ways));
+    }
+
+    std::vector<IdRange> batches(std::size_t max_members) {
+        std::sort(m_relations.begin(), m_relations.end());
+
+        std::vector<IdRange> result;
+        std::size_t members = 0;
+        for (const auto& r : m_relations) {
+            if (result.empty() || (members > 0 && members + r.second > max_members)) {
+                result.push_back(IdRange{r.first, r.first});
+                members = 0;
+            }
+            result.back().last = r.first;
+            members += r.second;
+        }
+
+        return result;
+    }
+
+}; // class MultipolygonBatcher
+
+/**
+ * Feeds the multipolygon relations in the given id range into the
+ * manager and remembers their member ways. Use with
+ * osmium::relations::read_relations().
+ */
+template <typename TManager>
+class BatchRelations : public osmium::handler::Handler {
+
+    const Options& m_options;
+    IdRange m_range;
+    TManager& m_manager;
+    std::vector<osmium::unsigned_object_id_type> m_way_ids;
+
+public:
+
+    BatchRelations(const Options& options, const IdRange& range, TManager& manager) :
+        m_options(options),
+        m_range(range),
+        m_manager(manager) {
+    }
+
+    void relation(const osmium::Relation& relation) {
+        if (!m_range.contains(relation.id()) || !is_wanted_multipolygon(m_options, relation)) {
+            return;
+        }
+        m_manager.relation(relation);
+        for (const auto& member : relation.members()) {
+            if (member.type() == osmium::item_type::way) {
+                m_way_ids.push_back(member.positive_ref());
+            }
+        }
+    }
+
+    void prepare_for_lookup() {
+        std::sort(m_way_ids.begin(), m_way_ids.end());
+        m_way_ids.erase(std::unique(m_way_ids.begin(), m_way_ids.end()), m_way_ids.end());
+        m_manager.prepare_for_lookup();
+    }
+
+    bool is_member_way(const osmium::Way& way) const {
+        return std::binary_search(m_way_ids.cbegin(), m_way_ids.cend(), way.positive_id());
+    }
+
+}; // class BatchRelations
+
+/**
+ * Handler for passes over the ways for all but the first batch: Only
+ * member ways of relations in the batch get their locations from the
+ * location handler and are handed to the multipolygon manager.
+ */
+template <typename TBatchRelations, typename TLocationHandler, typename TAreaHandler>
+class BatchMemberWays : public osmium::handler::Handler {
+
+    const TBatchRelations& m_batch_relations;
+    TLocationHandler& m_location_handler;
+    TAreaHandler& m_area_handler;
+
+public:
+
+    BatchMemberWays(const TBatchRelations& batch_relations, TLocationHandler& location_handler, TAreaHandler& area_handler) :
+        m_batch_relations(batch_relations),
+        m_location_handler(location_handler),
+        m_area_handler(area_handler) {
+    }
+
+    void way(osmium::Way& way) {
+        if (m_batch_relations.is_member_way(way)) {
+            m_location_handler.way(way);
+            m_area_handler.way(way);
+        }
+    }
+
+    void flush() {
+        m_area_handler.flush();
+    }
+
+}; // class BatchMemberWays
+
+#endif // MULTIPOLYGON_BATCHES_HPP
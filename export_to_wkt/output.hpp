@@ -0,0 +1,254 @@
+#ifndef OUTPUT_HPP
+#define OUTPUT_HPP
+
+// The code in this file is released into the Public Domain.
+
+#include <algorithm>
+#include <cstdint>
+#include <exception>
+#include <future>
+#include <memory>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <osmium/geom/tile.hpp>
+#include <osmium/io/detail/read_write.hpp>
+#include <osmium/io/writer_options.hpp>
+#include <osmium/osm/location.hpp>
+#include <osmium/osm/types.hpp>
+#include <osmium/thread/pool.hpp>
+#include <osmium/thread/queue.hpp>
+
+#include "compression.hpp"
+
+/**
+ * Get the position of tile (x, y) on the Hilbert curve filling the
+ * 2^zoom x 2^zoom tile grid.
+ */
+inline uint64_t hilbert_index(uint32_t zoom, uint32_t x, uint32_t y) noexcept {
+    const uint32_t n = 1U << zoom;
+    uint64_t d = 0;
+    for (uint32_t s = n / 2; s > 0; s /= 2) {
+        const uint32_t rx = (x & s) ? 1 : 0;
+        const uint32_t ry = (y & s) ? 1 : 0;
+        d += static_cast<uint64_t>(s) * s * ((3 * rx) ^ ry);
+        if (ry == 0) {
+            if (rx == 1) {
+                x = n - 1 - x;
+                y = n - 1 - y;
+            }
+            std::swap(x, y);
+        }
+    }
+    return d;
+}
+
+/**
+ * An output file with its own writer thread. Data is handed over to the
+ * thread in blocks through a queue. The blocks are futures, so they can
+ * be compressed in a thread pool while the writer thread keeps them in
+ * order.
+ */
+class OutputFile {
+
+    // Maximum number of blocks waiting in the queue
+    static constexpr const std::size_t max_queue_size = 20;
+
+    int m_fd;
+    osmium::thread::Queue<std::future<std::string>> m_queue{max_queue_size, "wkt_output"};
+    std::exception_ptr m_exception;
+    std::thread m_thread;
+
+    void push_ready(std::string&& data) {
+        std::promise<std::string> promise;
+        m_queue.push(promise.get_future());
+        promise.set_value(std::move(data));
+    }
+
+    void run() {
+        while (true) {
+            std::future<std::string> block;
+            m_queue.wait_and_pop(block);
+            // After an error, blocks are still taken from the queue (but
+            // not written), so nobody waits on a full queue. The end marker
+            // never throws.
+            try {
+                const std::string data{block.get()};
+                if (data.empty()) { // end marker
+                    break;
+                }
+                if (!m_exception) {
+                    osmium::io::detail::reliable_write(m_fd, data.data(), data.size());
+                }
+            } catch (...) {
+                if (!m_exception) {
+                    m_exception = std::current_exception();
+                }
+            }
+        }
+    }
+
+public:
+
+    explicit OutputFile(int fd) :
+        m_fd(fd),
+        m_thread(&OutputFile::run, this) {
+    }
+
+    OutputFile(const OutputFile&) = delete;
+    OutputFile& operator=(const OutputFile&) = delete;
+
+    OutputFile(OutputFile&&) = delete;
+    OutputFile& operator=(OutputFile&&) = delete;
+
+    ~OutputFile() {
+        try {
+            close();
+        } catch (...) {
+            // ignore exceptions in destructor
+        }
+    }
+
+    void write(std::string&& data) {
+        if (!data.empty()) {
+            push_ready(std::move(data));
+        }
+    }
+
+    // The future must not return an empty string.
+    void write(std::future<std::string>&& block) {
+        m_queue.push(std::move(block));
+    }
+
+    // Wait for the writer thread to finish and close the file. Throws
+    // if there was an error writing.
+    void close() {
+        if (!m_thread.joinable()) {
+            return;
+        }
+        push_ready(std::string{});
+        m_thread.join();
+        if (m_fd != 1) {
+            osmium::io::detail::reliable_close(m_fd);
+        }
+        if (m_exception) {
+            std::rethrow_exception(m_exception);
+        }
+    }
+
+}; // class OutputFile
+
+/**
+ * WKT output, either to STDOUT or to a number of files in an output
+ * directory. Objects are assigned to a file by the position on a Hilbert
+ * curve of the tile (on zoom level partition_zoom) containing the first
+ * coordinate of their geometry. Each file gets a contiguous range of the
+ * curve, so each contains the data of a spatially compact region.
+ *
+ * If compression is enabled, full blocks are compressed in a thread pool
+ * shared by all files.
+ */
+class Output {
+
+    // Write data in blocks of this size
+    static constexpr const std::size_t block_size = 1024UL * 1024UL;
+
+    static constexpr const uint32_t partition_zoom = 12;
+
+    // The pool is declared first, so it is destroyed last and the
+    // files can still get their pending blocks when they are closed.
+    compression_type m_compression;
+    std::unique_ptr<osmium::thread::Pool> m_pool;
+
+    std::vector<std::unique_ptr<OutputFile>> m_files;
+    std::vector<std::string> m_buffers;
+
+    std::size_t partition(const osmium::Location& location) const {
+        if (m_files.size() == 1) {
+            return 0;
+        }
+        const osmium::geom::Tile tile{partition_zoom, location};
+        const uint64_t index = hilbert_index(partition_zoom, tile.x, tile.y);
+        return static_cast<std::size_t>(index * m_files.size() >> (2 * partition_zoom));
+    }
+
+    void flush(std::size_t n) {
+        if (!m_pool || m_buffers[n].empty()) {
+            m_files[n]->write(std::move(m_buffers[n]));
+            return;
+        }
+        m_files[n]->write(m_pool->submit([data = std::move(m_buffers[n]), compression = m_compression]() {
+            return compress(compression, data);
+        }));
+    }
+
+    // Compression threads are only started if needed. If num_threads is
+    // 0 the number of cores is used. (The libosmium pool would use fewer
+    // threads or OSMIUM_POOL_THREADS for 0, so it is set explicitly.)
+    void init_compression(int num_threads) {
+        if (m_compression == compression_type::none) {
+            return;
+        }
+        if (num_threads == 0) {
+            num_threads = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+        }
+        m_pool = std::make_unique<osmium::thread::Pool>(num_threads);
+    }
+
+public:
+
+    static std::string partition_filename(const std::string& directory, std::size_t n, compression_type compression = compression_type::none) {
+        std::string num{std::to_string(n)};
+        if (num.size() < 4) {
+            num.insert(0, 4 - num.size(), '0');
+        }
+        return directory + "/" + num + ".wkt" + compression_suffix(compression);
+    }
+
+    // Write to STDOUT
+    explicit Output(compression_type compression = compression_type::none, int compression_threads = 0) :
+        m_compression(compression) {
+        init_compression(compression_threads);
+        m_files.push_back(std::make_unique<OutputFile>(1));
+        m_buffers.resize(1);
+    }
+
+    // Write to num_partitions files in directory
+    Output(const std::string& directory, std::size_t num_partitions, compression_type compression = compression_type::none, int compression_threads = 0) :
+        m_compression(compression) {
+        init_compression(compression_threads);
+        for (std::size_t n = 0; n < num_partitions; ++n) {
+            const int fd = osmium::io::detail::open_for_writing(partition_filename(directory, n, compression), osmium::io::overwrite::allow);
+            m_files.push_back(std::make_unique<OutputFile>(fd));
+        }
+        m_buffers.resize(num_partitions);
+    }
+
+    void add(char type, osmium::object_id_type id, const osmium::Location& location, const std::string& wkt) {
+        const std::size_t n = partition(location);
+        std::string& buffer = m_buffers[n];
+        buffer += type;
+        buffer += std::to_string(id);
+        buffer += ' ';
+        buffer += wkt;
+        buffer += '\n';
+        if (buffer.size() >= block_size) {
+            flush(n);
+            buffer.clear();
+            buffer.reserve(block_size + 1024);
+        }
+    }
+
+    void close() {
+        for (std::size_t n = 0; n < m_files.size(); ++n) {
+            flush(n);
+            m_buffers[n].clear();
+            m_files[n]->close();
+        }
+    }
+
+}; // class Output
+
+#endif // OUTPUT_HPP
@@ -0,0 +1,241 @@
+#ifndef PARALLEL_MULTIPOLYGON_MANAGER_HPP
+#define PARALLEL_MULTIPOLYGON_MANAGER_HPP
+
+// The code in this file is released into the Public Domain.
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <future>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <osmium/memory/buffer.hpp>
+#include <osmium/osm/location.hpp>
+#include <osmium/osm/relation.hpp>
+#include <osmium/osm/way.hpp>
+#include <osmium/relations/relations_manager.hpp>
+#include <osmium/tags/taglist.hpp>
+#include <osmium/tags/tags_filter.hpp>
+#include <osmium/thread/queue.hpp>
+
+/**
+ * Works like the osmium::area::MultipolygonManager, but complete
+ * multipolygon relations can be assembled by a pool of worker threads
+ * instead of inline in the thread calling the second pass handler.
+ *
+ * The relation and its member ways are copied into a buffer which is
+ * handed to a worker. The resulting areas are added to the output buffer
+ * of the manager in the order the relations were completed, so they end
+ * up in the callback of the handler as usual. Call finish() after the
+ * second pass to wait for all outstanding work.
+ *
+ * Simple areas from closed ways are cheap to assemble and are always
+ * built inline.
+ */
+template <typename TAssembler>
+class ParallelMultipolygonManager : public osmium::relations::RelationsManager<ParallelMultipolygonManager<TAssembler>, false, true, false> {
+
+    using assembler_config_type = typename TAssembler::config_type;
+    using task_type = std::packaged_task<osmium::memory::Buffer()>;
+
+    static constexpr const std::size_t initial_buffer_size = 64UL * 1024UL;
+
+    // Maximum number of relations waiting for or being assembled
+    static constexpr const std::size_t max_pending = 1000;
+
+    const assembler_config_type m_assembler_config;
+    osmium::TagsFilter m_filter;
+
+    osmium::thread::Queue<task_type> m_queue{max_pending, "assembler"};
+    std::vector<std::thread> m_threads;
+    std::deque<std::future<osmium::memory::Buffer>> m_results;
+
+    void worker() {
+        while (true) {
+            task_type task;
+            m_queue.wait_and_pop(task);
+            if (!task.valid()) { // end marker
+                return;
+            }
+            task();
+        }
+    }
+
+    static osmium::memory::Buffer assemble(const assembler_config_type& config, const osmium::memory::Buffer& input) {
+        osmium::memory::Buffer output{initial_buffer_size, osmium::memory::Buffer::auto_grow::yes};
+
+        const osmium::Relation& relation = *input.cbegin<osmium::Relation>();
+        std::vector<const osmium::Way*> ways;
+        for (auto it = input.cbegin<osmium::Way>(); it != input.cend<osmium::Way>(); ++it) {
+            ways.push_back(&*it);
+        }
+
+        try {
+            TAssembler assembler{config};
+            assembler(relation, ways, output);
+        } catch (const osmium::invalid_location&) {
+            // ignore
+        }
+
+        return output;
+    }
+
+    void add_result(std::future<osmium::memory::Buffer>& result) {
+        const osmium::memory::Buffer areas{result.get()};
+        this->buffer().add_buffer(areas);
+        this->buffer().commit();
+        this->possibly_flush();
+    }
+
+    // Move results of all finished relations at the front of the queue
+    // to the output buffer. If wait is set, also wait for the others.
+    void collect_results(bool wait) {
+        while (!m_results.empty()) {
+            if (!wait && m_results.front().wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+                return;
+            }
+            add_result(m_results.front());
+            m_results.pop_front();
+        }
+    }
+
+public:
+
+    ParallelMultipolygonManager(const assembler_config_type& assembler_config, const osmium::TagsFilter& filter, unsigned int num_threads) :
+        m_assembler_config(assembler_config),
+        m_filter(filter) {
+        for (unsigned int i = 0; i < num_threads; ++i) {
+            m_threads.emplace_back(&ParallelMultipolygonManager::worker, this);
+        }
+    }
+
+    ParallelMultipolygonManager(const ParallelMultipolygonManager&) = delete;
+    ParallelMultipolygonManager& operator=(const ParallelMultipolygonManager&) = delete;
+
+    ParallelMultipolygonManager(ParallelMultipolygonManager&&) = delete;
+    ParallelMultipolygonManager& operator=(ParallelMultipolygonManager&&) = delete;
+
+    ~ParallelMultipolygonManager() {
+        for (std::size_t i = 0; i < m_threads.size(); ++i) {
+            m_queue.push(task_type{});
+        }
+        for (auto& thread : m_threads) {
+            thread.join();
+        }
+    }
+
+    /**
+     * We are interested in all relations tagged with type=multipolygon
+     * or type=boundary with at least one way member and matching the
+     * filter.
+     */
+    bool new_relation(const osmium::Relation& relation) const {
+        const char* type = relation.tags().get_value_by_key("type");
+        if (type == nullptr) {
+            return false;
+        }
+
+        if ((!std::strcmp(type, "multipolygon") || !std::strcmp(type, "boundary")) &&
+            osmium::tags::match_any_of(relation.tags(), std::cref(m_filter))) {
+            return std::any_of(relation.members().cbegin(), relation.members().cend(), [](const osmium::RelationMember& member) {
+                return member.type() == osmium::item_type::way;
+            });
+        }
+
+        return false;
+    }
+
+    bool new_member(const osmium::Relation& /*relation*/, const osmium::RelationMember& member, std::size_t /*n*/) const noexcept {
+        return member.type() == osmium::item_type::way;
+    }
+
+    void complete_relation(const osmium::Relation& relation) {
+        if (m_threads.empty()) {
+            std::vector<const osmium::Way*> ways;
+            ways.reserve(relation.members().size());
+            for (const auto& member : relation.members()) {
+                if (member.ref() != 0) {
+                    ways.push_back(this->get_member_way(member.ref()));
+                }
+            }
+
+            try {
+                TAssembler assembler{m_assembler_config};
+                assembler(relation, ways, this->buffer());
+            } catch (const osmium::invalid_location&) {
+                // ignore
+            }
+            return;
+        }
+
+        // The member ways will be removed from the members database when
+        // this function returns, so we need a copy for the worker.
+        osmium::memory::Buffer input{initial_buffer_size, osmium::memory::Buffer::auto_grow::yes};
+        input.add_item(relation);
+        input.commit();
+        for (const auto& member : relation.members()) {
+            if (member.ref() != 0) {
+                input.add_item(*this->get_member_way(member.ref()));
+                input.commit();
+            }
+        }
+
+        task_type task{[config = m_assembler_config, input = std::move(input)]() {
+            return assemble(config, input);
+        }};
+        m_results.push_back(task.get_future());
+        m_queue.push(std::move(task));
+
+        if (m_results.size() >= max_pending) {
+            add_result(m_results.front());
+            m_results.pop_front();
+        }
+        collect_results(false);
+    }
+
+    void after_way(const osmium::Way& way) {
+        collect_results(false);
+
+        // you need at least 4 nodes to make up a polygon
+        if (way.nodes().size() <= 3) {
+            return;
+        }
+
+        try {
+            if (!way.nodes().front().location() || !way.nodes().back().location()) {
+                throw osmium::invalid_location{"invalid location"};
+            }
+
+            if (way.ends_have_same_location()) {
+                if (way.tags().has_tag("area", "no")) {
+                    return;
+                }
+
+                if (osmium::tags::match_none_of(way.tags(), std::cref(m_filter))) {
+                    return;
+                }
+
+                TAssembler assembler{m_assembler_config};
+                assembler(way, this->buffer());
+                this->possibly_flush();
+            }
+        } catch (const osmium::invalid_location&) {
+            // ignore ways with missing node locations
+        }
+    }
+
+    /**
+     * Wait for all relations to be assembled and flush the output.
+     */
+    void finish() {
+        collect_results(true);
+        this->flush_output();
+    }
+
+}; // class ParallelMultipolygonManager
+
+#endif // PARALLEL_MULTIPOLYGON_MANAGER_HPP
@@ -0,0 +1,221 @@
+#ifndef RUN_STATS_HPP
+#define RUN_STATS_HPP
+
+// The code in this file is released into the Public Domain.
+
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#ifndef _WIN32
+# include <sys/resource.h>
+#endif
+
+/**
+ * Collects statistics about a program run: The time spent in different
+ * phases of the program, counters (for instance for the number of objects
+ * read or features written), and the peak memory use. They can be written
+ * out as JSON with write_json().
+ *
+ * Phases are timed with a Phase object, which stops the timer when it goes
+ * out of scope:
+ *
+ * @code
+ *   {
+ *       const auto phase = stats.phase("read");
+ *       ...
+ *   }
+ *   stats.add("nodes", num_nodes);
+ * @endcode
+ *
+ * All functions are thread safe. If the same phase runs in several threads
+ * at the same time, the times add up.
+ */
+class RunStats {
+
+    using clock = std::chrono::steady_clock;
+
+    struct phase_info {
+        std::string name;
+        double seconds;
+        uint64_t count;
+    };
+
+    // Phases and counters are kept in the order they were first used.
+    std::string m_program;
+    clock::time_point m_start;
+    std::vector<phase_info> m_phases;
+    std::vector<std::pair<std::string, uint64_t>> m_counters;
+    mutable std::mutex m_mutex;
+
+    static void write_string(std::ostream& out, const std::string& str) {
+        out << '"';
+        for (const char c : str) {
+            if (c == '"' || c == '\\') {
+                out << '\\';
+            }
+            out << c;
+        }
+        out << '"';
+    }
+
+    void add_phase_time(const std::string& name, double seconds) {
+        const std::lock_guard<std::mutex> lock{m_mutex};
+        for (auto& p : m_phases) {
+            if (p.name == name) {
+                p.seconds += seconds;
+                ++p.count;
+                return;
+            }
+        }
+        m_phases.push_back(phase_info{name, seconds, 1});
+    }
+
+public:
+
+    /**
+     * Times one phase of the program from construction until stop() is
+     * called or it goes out of scope.
+     */
+    class Phase {
+
+        RunStats* m_stats;
+        std::string m_name;
+        clock::time_point m_start;
+
+    public:
+
+        Phase(RunStats& stats, std::string name) :
+            m_stats(&stats),
+            m_name(std::move(name)),
+            m_start(clock::now()) {
+        }
+
+        Phase(const Phase&) = delete;
+        Phase& operator=(const Phase&) = delete;
+
+        Phase(Phase&& other) noexcept :
+            m_stats(other.m_stats),
+            m_name(std::move(other.m_name)),
+            m_start(other.m_start) {
+            other.m_stats = nullptr;
+        }
+
+        Phase& operator=(Phase&&) = delete;
+
+        ~Phase() {
+            stop();
+        }
+
+        void stop() {
+            if (m_stats) {
+                const std::chrono::duration<double> duration = clock::now() - m_start;
+                m_stats->add_phase_time(m_name, duration.count());
+                m_stats = nullptr;
+            }
+        }
+
+    }; // class Phase
+
+    explicit RunStats(std::string program) :
+        m_program(std::move(program)),
+        m_start(clock::now()) {
+    }
+
+    Phase phase(std::string name) {
+        return Phase{*this, std::move(name)};
+    }
+
+    /**
+     * Add n to the counter with the given name.
+     */
+    void add(const std::string& name, uint64_t n = 1) {
+        const std::lock_guard<std::mutex> lock{m_mutex};
+        for (auto& c : m_counters) {
+            if (c.first == name) {
+                c.second += n;
+                return;
+            }
+        }
+        m_counters.emplace_back(name, n);
+    }
+
+    /**
+     * Seconds since this object was created.
+     */
+    double elapsed() const {
+        const std::chrono::duration<double> duration = clock::now() - m_start;
+        return duration.count();
+    }
+
+    /**
+     * Peak resident set size of this process in kBytes (0 if unknown).
+     */
+    static uint64_t peak_rss_kbytes() noexcept {
+#ifdef _WIN32
+        return 0;
+#else
+        struct rusage usage{};
+        if (getrusage(RUSAGE_SELF, &usage) != 0) {
+            return 0;
+        }
+# ifdef __APPLE__
+        return static_cast<uint64_t>(usage.ru_maxrss) / 1024; // bytes on macOS
+# else
+        return static_cast<uint64_t>(usage.ru_maxrss);
+# endif
+#endif
+    }
+
+    /**
+     * Write all statistics as JSON object. The throughput of each counter
+     * is calculated over the whole run time.
+     */
+    void write_json(std::ostream& out) const {
+        const std::lock_guard<std::mutex> lock{m_mutex};
+        const double seconds = elapsed();
+
+        out << "{\"program\":";
+        write_string(out, m_program);
+        out << ",\"seconds\":" << seconds
+            << ",\"peak_rss_kbytes\":" << peak_rss_kbytes()
+            << ",\"phases\":[";
+        for (std::size_t i = 0; i < m_phases.size(); ++i) {
+            out << (i == 0 ? "" : ",") << "{\"name\":";
+            write_string(out, m_phases[i].name);
+            out << ",\"seconds\":" << m_phases[i].seconds
+                << ",\"count\":" << m_phases[i].count << '}';
+        }
+        out << "],\"counters\":{";
+        for (std::size_t i = 0; i < m_counters.size(); ++i) {
+            out << (i == 0 ? "" : ",");
+            write_string(out, m_counters[i].first);
+            out << ":{\"count\":" << m_counters[i].second
+                << ",\"per_second\":" << (seconds > 0 ? static_cast<double>(m_counters[i].second) / seconds : 0.0)
+                << '}';
+        }
+        out << "}}\n";
+    }
+
+    /**
+     * Write all statistics as JSON object into the file. Throws
+     * std::runtime_error if that fails.
+     */
+    void write_json(const std::string& filename) const {
+        std::ofstream out{filename};
+        write_json(out);
+        out.close();
+        if (!out) {
+            throw std::runtime_error{"Can not write statistics to '" + filename + "'"};
+        }
+    }
+
+}; // class RunStats
+
+#endif // RUN_STATS_HPP
@@ -0,0 +1,226 @@
+#ifndef AREA_CACHE_HPP
+#define AREA_CACHE_HPP
+
+// The code in this file is released into the Public Domain.
+
+#include <cstdint>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <osmium/area/assembler_legacy.hpp>
+#include <osmium/area/stats.hpp>
+#include <osmium/memory/buffer.hpp>
+#include <osmium/osm/area.hpp>
+#include <osmium/osm/relation.hpp>
+#include <osmium/osm/way.hpp>
+
+/**
+ * Remembers the areas assembled for one point in time, so they can be
+ * reused for the next point in time if nothing they were assembled from
+ * has changed. Each area is identified by its area id and a hash over the
+ * versions of the way or relation and its member ways and the locations of
+ * all nodes. Only areas assembled in the previous time step are kept.
+ *
+ * Use one cache for a sequence of time steps and call next_step() between
+ * them.
+ */
+class AreaCache {
+
+    static constexpr const std::size_t initial_buffer_size = 1024UL * 1024UL;
+
+    // Offset of the area in the buffer or no_area if nothing was created.
+    static constexpr const std::size_t no_area = static_cast<std::size_t>(-1);
+
+    struct entry {
+        uint64_t hash;
+        std::size_t offset;
+    };
+
+    using map_type = std::unordered_map<osmium::object_id_type, entry>;
+
+    map_type m_prev_map;
+    osmium::memory::Buffer m_prev_buffer{initial_buffer_size, osmium::memory::Buffer::auto_grow::yes};
+
+    map_type m_curr_map;
+    osmium::memory::Buffer m_curr_buffer{initial_buffer_size, osmium::memory::Buffer::auto_grow::yes};
+
+    std::size_t m_hits = 0;
+    std::size_t m_misses = 0;
+
+    bool m_enabled;
+
+public:
+
+    /**
+     * A disabled cache never finds anything and doesn't remember
+     * anything, so all areas are assembled again in each time step.
+     */
+    explicit AreaCache(bool enabled = true) :
+        m_enabled(enabled) {
+    }
+
+    /**
+     * Copy area with the given id and hash from the last time step into
+     * out_buffer. Returns false if it isn't in the cache.
+     */
+    bool lookup(osmium::object_id_type area_id, uint64_t hash, osmium::memory::Buffer& out_buffer) {
+        if (!m_enabled) {
+            ++m_misses;
+            return false;
+        }
+
+        const auto it = m_prev_map.find(area_id);
+        if (it == m_prev_map.end() || it->second.hash != hash) {
+            ++m_misses;
+            return false;
+        }
+
+        ++m_hits;
+        const std::size_t offset = it->second.offset;
+        if (offset == no_area) {
+            m_curr_map[area_id] = it->second;
+            return true;
+        }
+
+        const auto& item = m_prev_buffer.get<osmium::memory::Item>(offset);
+        m_curr_map[area_id] = entry{hash, m_curr_buffer.committed()};
+        m_curr_buffer.add_item(item);
+        m_curr_buffer.commit();
+        out_buffer.add_item(item);
+        out_buffer.commit();
+        return true;
+    }
+
+    /**
+     * Remember the area (if any) the assembler added to buffer after the
+     * given offset.
+     */
+    void remember(osmium::object_id_type area_id, uint64_t hash, const osmium::memory::Buffer& buffer, std::size_t offset) {
+        if (!m_enabled) {
+            return;
+        }
+        if (offset == buffer.committed()) {
+            m_curr_map[area_id] = entry{hash, no_area};
+            return;
+        }
+        m_curr_map[area_id] = entry{hash, m_curr_buffer.committed()};
+        m_curr_buffer.add_item(buffer.get<osmium::memory::Item>(offset));
+        m_curr_buffer.commit();
+    }
+
+    /**
+     * Forget everything from the last time step, keep everything from the
+     * current one.
+     */
+    void next_step() {
+        using std::swap;
+        swap(m_prev_map, m_curr_map);
+        swap(m_prev_buffer, m_curr_buffer);
+        m_curr_map.clear();
+        m_curr_buffer.clear();
+        m_hits = 0;
+        m_misses = 0;
+    }
+
+    std::size_t hits() const noexcept {
+        return m_hits;
+    }
+
+    std::size_t misses() const noexcept {
+        return m_misses;
+    }
+
+}; // class AreaCache
+
+namespace detail {
+
+    inline void hash_combine(uint64_t& hash, uint64_t value) noexcept {
+        // FNV-1a over the bytes of the value
+        for (int i = 0; i < 8; ++i) {
+            hash ^= (value >> (i * 8)) & 0xffU;
+            hash *= 0x100000001b3ULL;
+        }
+    }
+
+    inline void hash_way(uint64_t& hash, const osmium::Way& way) noexcept {
+        hash_combine(hash, static_cast<uint64_t>(way.id()));
+        hash_combine(hash, way.version());
+        for (const auto& node_ref : way.nodes()) {
+            hash_combine(hash, static_cast<uint64_t>(node_ref.ref()));
+            hash_combine(hash, static_cast<uint32_t>(node_ref.location().x()));
+            hash_combine(hash, static_cast<uint32_t>(node_ref.location().y()));
+        }
+    }
+
+} // namespace detail
+
+/**
+ * Assembler for use with the multipolygon manager that gets areas from the
+ * AreaCache if possible and only calls TAssembler for areas which have
+ * changed.
+ */
+template <typename TAssembler>
+class CachingAssembler {
+
+public:
+
+    struct config_type : public TAssembler::config_type {
+        AreaCache* cache = nullptr;
+    };
+
+private:
+
+    TAssembler m_assembler;
+    AreaCache* m_cache;
+
+    static constexpr const uint64_t hash_init = 0xcbf29ce484222325ULL;
+
+public:
+
+    explicit CachingAssembler(const config_type& config) :
+        m_assembler(config),
+        m_cache(config.cache) {
+    }
+
+    bool operator()(const osmium::Way& way, osmium::memory::Buffer& out_buffer) {
+        uint64_t hash = hash_init;
+        detail::hash_way(hash, way);
+
+        const auto area_id = osmium::object_id_to_area_id(way.id(), osmium::item_type::way);
+        if (m_cache->lookup(area_id, hash, out_buffer)) {
+            return true;
+        }
+
+        const std::size_t offset = out_buffer.committed();
+        const bool okay = m_assembler(way, out_buffer);
+        m_cache->remember(area_id, hash, out_buffer, offset);
+        return okay;
+    }
+
+    bool operator()(const osmium::Relation& relation, const std::vector<const osmium::Way*>& members, osmium::memory::Buffer& out_buffer) {
+        uint64_t hash = hash_init;
+        detail::hash_combine(hash, static_cast<uint64_t>(relation.id()));
+        detail::hash_combine(hash, relation.version());
+        for (const auto* way : members) {
+            detail::hash_way(hash, *way);
+        }
+
+        const auto area_id = osmium::object_id_to_area_id(relation.id(), osmium::item_type::relation);
+        if (m_cache->lookup(area_id, hash, out_buffer)) {
+            return true;
+        }
+
+        const std::size_t offset = out_buffer.committed();
+        const bool okay = m_assembler(relation, members, out_buffer);
+        m_cache->remember(area_id, hash, out_buffer, offset);
+        return okay;
+    }
+
+    const osmium::area::area_stats& stats() const noexcept {
+        return m_assembler.stats();
+    }
+
+}; // class CachingAssembler
+
+#endif // AREA_CACHE_HPP
@@ -3,6 +3,8 @@
 
 #include "cmdline_options.hpp"
 
+#include <stdexcept>
+
 #include <boost/program_options.hpp>
 
 osmium::Timestamp Options::parse_time(std::string t) {
@@ -22,6 +24,39 @@ osmium::Timestamp Options::parse_time(std::string t) {
     }
 }
 
+osmium::Box Options::parse_bbox(const std::string& str) {
+    std::vector<double> coordinates;
+    try {
+        std::string::size_type start = 0;
+        while (true) {
+            const auto comma = str.find(',', start);
+            const std::string value{str.substr(start, comma - start)};
+            std::size_t pos = 0;
+            coordinates.push_back(std::stod(value, &pos));
+            if (pos != value.size()) {
+                coordinates.clear();
+                break;
+            }
+            if (comma == std::string::npos) {
+                break;
+            }
+            start = comma + 1;
+        }
+    } catch (const std::logic_error&) {
+        coordinates.clear();
+    }
+
+    if (coordinates.size() == 4 && coordinates[0] < coordinates[2] && coordinates[1] < coordinates[3]) {
+        const osmium::Box box{coordinates[0], coordinates[1], coordinates[2], coordinates[3]};
+        if (box.valid()) {
+            return box;
+        }
+    }
+
+    std::cerr << "Can't understand the bounding box, format should be LEFT,BOTTOM,RIGHT,TOP.\n";
+    std::exit(return_code::fatal);
+}
+
 Options::Options(int argc, char* argv[]) {
     namespace po = boost::program_options;
 
@@ -38,6 +73,22 @@ Options::Options(int argc, char* argv[]) {
             ("start-time,s", po::value<std::string>(), "Start time (yyyy-mm-dd)")
             ("end-time,e", po::value<std::string>(), "End time (yyyy-mm-dd)")
             ("time-step,S", po::value<int>(), "Time step in days (default: 7 days)")
+            ("handlers", po::value<std::string>(), "Comma-separated list of handlers creating the output layers (default: buildings)")
+            ("bbox,b", po::value<std::string>(), "Only use objects inside this bounding box (LEFT,BOTTOM,RIGHT,TOP)")
+            ("polygon,p", po::value<std::string>(), "Only use objects inside the (multi)polygons in this file (any format OGR can read)")
+            ("filter-tags", "Only use objects with the tags the selected handlers need")
+            ("sweep", "Sweep through history once instead of filtering it for each time step")
+            ("no-area-cache", "Assemble all areas in each time step instead of reusing unchanged ones")
+            ("compact,c", "Keep history in memory in compact form (can not be used with --sweep)")
+            ("temporal,T", "Write all time steps into one layer per handler with valid_from/valid_to fields")
+            ("history-file,H", po::value<std::string>(), "Keep history data in this file instead of in memory (created from input file if it doesn't exist)")
+            ("animation,a", po::value<std::string>(), "Write animated GIF to this file instead of vector output files")
+            ("width,w", po::value<int>(), "Width of animation in pixels (default: 1024)")
+            ("delay,d", po::value<int>(), "Delay between animation frames in 1/100 seconds (default: 10)")
+            ("geometry-path", po::value<std::string>(), "Create geometries 'direct' (default) or through the OGR 'factory'")
+            ("transaction-size", po::value<uint64_t>(), "Number of features written in one transaction if output format supports it (default: 10000, 0 = no transactions)")
+            ("threads,t", po::value<unsigned int>(), "Number of time steps to work on in parallel (default: 1)")
+            ("stats-json", po::value<std::string>(), "Write statistics (timing, counters, memory use) as JSON to this file")
         ;
 
         po::options_description hidden("Hidden options");
@@ -82,6 +133,30 @@ Options::Options(int argc, char* argv[]) {
             output_format = vm["output-format"].as<std::string>();
         }
 
+        if (vm.count("history-file")) {
+            history_file = vm["history-file"].as<std::string>();
+        }
+
+        if (vm.count("animation")) {
+            animation_file = vm["animation"].as<std::string>();
+        }
+
+        if (vm.count("width")) {
+            width = vm["width"].as<int>();
+            if (width < 1 || width > 65535) {
+                std::cerr << "Width must be between 1 and 65535.\n";
+                std::exit(return_code::fatal);
+            }
+        }
+
+        if (vm.count("delay")) {
+            delay = vm["delay"].as<int>();
+            if (delay < 0 || delay > 65535) {
+                std::cerr << "Delay must be between 0 and 65535.\n";
+                std::exit(return_code::fatal);
+            }
+        }
+
         if (vm.count("start-time")) {
             start_time = parse_time(vm["start-time"].as<std::string>());
         }
@@ -94,6 +169,76 @@ Options::Options(int argc, char* argv[]) {
             time_step = vm["time-step"].as<int>();
         }
 
+        if (vm.count("handlers")) {
+            handlers.clear();
+            const std::string list{vm["handlers"].as<std::string>()};
+            std::string::size_type start = 0;
+            while (true) {
+                const auto comma = list.find(',', start);
+                handlers.push_back(list.substr(start, comma - start));
+                if (comma == std::string::npos) {
+                    break;
+                }
+                start = comma + 1;
+            }
+        }
+
+        if (vm.count("bbox")) {
+            bbox = parse_bbox(vm["bbox"].as<std::string>());
+        }
+
+        if (vm.count("polygon")) {
+            polygon_file = vm["polygon"].as<std::string>();
+        }
+
+        if (vm.count("filter-tags")) {
+            filter_tags = true;
+        }
+
+        if (vm.count("sweep")) {
+            sweep = true;
+        }
+
+        if (vm.count("no-area-cache")) {
+            area_cache = false;
+        }
+
+        if (vm.count("temporal")) {
+            temporal = true;
+        }
+
+        if (vm.count("compact")) {
+            if (sweep) {
+                std::cerr << "Can not use --compact and --sweep together.\n";
+                std::exit(return_code::fatal);
+            }
+            compact = true;
+        }
+
+        if (vm.count("geometry-path")) {
+            geometry_path = vm["geometry-path"].as<std::string>();
+            if (geometry_path != "direct" && geometry_path != "factory") {
+                std::cerr << "Geometry path must be 'direct' or 'factory'.\n";
+                std::exit(return_code::fatal);
+            }
+        }
+
+        if (vm.count("transaction-size")) {
+            transaction_size = vm["transaction-size"].as<uint64_t>();
+        }
+
+        if (vm.count("stats-json")) {
+            stats_filename = vm["stats-json"].as<std::string>();
+        }
+
+        if (vm.count("threads")) {
+            threads = vm["threads"].as<unsigned int>();
+            if (threads == 0) {
+                std::cerr << "Number of threads must be at least 1.\n";
+                std::exit(return_code::fatal);
+            }
+        }
+
     } catch (const boost::program_options::error& e) {
         std::cerr << "Error parsing command line: " << e.what() << '\n';
         std::exit(return_code::fatal);
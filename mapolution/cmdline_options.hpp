@@ -3,8 +3,11 @@
 
 // The code in this file is released into the Public Domain.
 
+#include <cstdint>
 #include <string>
+#include <vector>
 
+#include <osmium/osm/box.hpp>
 #include <osmium/osm/timestamp.hpp>
 #include <osmium/util/verbose_output.hpp>
 
@@ -22,15 +25,38 @@ struct Options {
     std::string output_directory {"out"};
     std::string input_format;
     std::string output_format {"ESRI Shapefile"};
+    std::string geometry_path {"direct"};
+    std::string history_file;
+    std::string animation_file;
+    std::string polygon_file;
+    std::string stats_filename;
+    int width = 1024;
+    int delay = 10; // hundredths of a second
 
     osmium::Timestamp start_time;
     osmium::Timestamp end_time;
     int time_step = 7; // default is 7 days == one week
 
+    std::vector<std::string> handlers {"buildings"};
+
+    osmium::Box bbox;
+
+    bool sweep = false;
+    bool compact = false;
+    bool temporal = false;
+    bool filter_tags = false;
+    bool area_cache = true;
+
+    unsigned int threads = 1;
+
+    uint64_t transaction_size = 10000;
+
     Options(int argc, char* argv[]);
 
     osmium::Timestamp parse_time(std::string);
 
+    osmium::Box parse_bbox(const std::string&);
+
 }; // struct Options
 
 #endif // CMDLINE_OPTIONS_HPP
@@ -0,0 +1,353 @@
+#ifndef COMPACT_HISTORY_HPP
+#define COMPACT_HISTORY_HPP
+
+// The code in this file is released into the Public Domain.
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <protozero/varint.hpp>
+
+#include <osmium/builder/osm_object_builder.hpp>
+#include <osmium/memory/buffer.hpp>
+#include <osmium/osm/item_type.hpp>
+#include <osmium/osm/location.hpp>
+#include <osmium/osm/node.hpp>
+#include <osmium/osm/object.hpp>
+#include <osmium/osm/relation.hpp>
+#include <osmium/osm/timestamp.hpp>
+#include <osmium/osm/types.hpp>
+#include <osmium/osm/way.hpp>
+
+/**
+ * All versions of all objects in the history data in a compact form
+ * containing only what mapolution needs: id, version, timestamp, and
+ * visibility, tags, and the location, node list, or member list.
+ *
+ * For each object the data of all versions is stored one after the other
+ * as varints, delta encoded against the previous version. Strings in tags
+ * and member roles are stored only once, as are identical tag lists. Node
+ * lists and member lists are only stored again if they changed from the
+ * previous version. User names, changesets, and uids are not stored.
+ *
+ * This class is immutable after construction, so it can be shared between
+ * threads. Use snapshot() to get the objects visible at some point in time.
+ */
+class CompactHistory {
+
+    struct object_entry {
+        osmium::object_id_type id;
+        std::size_t offset; // of first version in m_versions
+        uint32_t num_versions;
+        osmium::item_type type;
+    };
+
+    // Decoded data of one version
+    struct version_state {
+        int64_t version = 0;
+        int64_t timestamp = 0;
+        bool visible = false;
+        std::size_t tags = 0; // offset in m_tags
+        int64_t x = 0;
+        int64_t y = 0;
+        std::size_t list = 0; // offset in m_lists
+    };
+
+    std::vector<object_entry> m_objects;
+    std::string m_versions;
+
+    // All strings, each '\0' terminated
+    std::string m_strings;
+
+    // Tag lists: number of tags followed by offsets of key and value
+    // strings for each tag.
+    std::vector<std::size_t> m_tags;
+
+    // Way node lists and relation member lists
+    std::string m_lists;
+
+    // Only needed while building
+    std::unordered_map<std::string, std::size_t> m_string_index;
+    std::map<std::vector<std::size_t>, std::size_t> m_tags_index;
+
+    void add_varint(std::string& out, uint64_t value) {
+        protozero::write_varint(std::back_inserter(out), value);
+    }
+
+    void add_delta(std::string& out, int64_t value, int64_t& prev) {
+        add_varint(out, protozero::encode_zigzag64(value - prev));
+        prev = value;
+    }
+
+    std::size_t add_string(const char* str) {
+        const auto result = m_string_index.emplace(str, m_strings.size());
+        if (result.second) {
+            m_strings.append(str);
+            m_strings += '\0';
+        }
+        return result.first->second;
+    }
+
+    std::size_t add_tags(const osmium::TagList& tags) {
+        std::vector<std::size_t> list;
+        for (const auto& tag : tags) {
+            list.push_back(add_string(tag.key()));
+            list.push_back(add_string(tag.value()));
+        }
+
+        const auto result = m_tags_index.emplace(list, m_tags.size());
+        if (result.second) {
+            m_tags.push_back(tags.size());
+            m_tags.insert(m_tags.end(), list.cbegin(), list.cend());
+        }
+        return result.first->second;
+    }
+
+    std::size_t add_nodes(const osmium::WayNodeList& nodes) {
+        const std::size_t offset = m_lists.size();
+        add_varint(m_lists, nodes.size());
+        int64_t prev = 0;
+        for (const auto& node_ref : nodes) {
+            add_delta(m_lists, node_ref.ref(), prev);
+        }
+        return offset;
+    }
+
+    std::size_t add_members(const osmium::RelationMemberList& members) {
+        const std::size_t offset = m_lists.size();
+        add_varint(m_lists, members.size());
+        int64_t prev = 0;
+        for (const auto& member : members) {
+            add_varint(m_lists, static_cast<uint64_t>(member.type()));
+            add_delta(m_lists, member.ref(), prev);
+            add_varint(m_lists, add_string(member.role()));
+        }
+        return offset;
+    }
+
+    static bool same_nodes(const osmium::WayNodeList& a, const osmium::WayNodeList& b) {
+        return std::equal(a.cbegin(), a.cend(), b.cbegin(), b.cend(), [](const osmium::NodeRef& na, const osmium::NodeRef& nb) {
+            return na.ref() == nb.ref();
+        });
+    }
+
+    static bool same_members(const osmium::RelationMemberList& a, const osmium::RelationMemberList& b) {
+        return std::equal(a.cbegin(), a.cend(), b.cbegin(), b.cend(), [](const osmium::RelationMember& ma, const osmium::RelationMember& mb) {
+            return ma.type() == mb.type() && ma.ref() == mb.ref() && !std::strcmp(ma.role(), mb.role());
+        });
+    }
+
+    void add_version(const osmium::OSMObject* prev_object, const osmium::OSMObject& object, version_state& state) {
+        add_delta(m_versions, object.version(), state.version);
+        add_delta(m_versions, uint32_t(object.timestamp()), state.timestamp);
+        add_varint(m_versions, (add_tags(object.tags()) << 1U) | (object.visible() ? 1U : 0U));
+
+        switch (object.type()) {
+            case osmium::item_type::node: {
+                const auto& node = static_cast<const osmium::Node&>(object);
+                add_delta(m_versions, node.location().x(), state.x);
+                add_delta(m_versions, node.location().y(), state.y);
+                break;
+            }
+            case osmium::item_type::way: {
+                const auto& way = static_cast<const osmium::Way&>(object);
+                if (!prev_object || !same_nodes(static_cast<const osmium::Way*>(prev_object)->nodes(), way.nodes())) {
+                    state.list = add_nodes(way.nodes());
+                }
+                add_varint(m_versions, state.list);
+                break;
+            }
+            case osmium::item_type::relation: {
+                const auto& relation = static_cast<const osmium::Relation&>(object);
+                if (!prev_object || !same_members(static_cast<const osmium::Relation*>(prev_object)->members(), relation.members())) {
+                    state.list = add_members(relation.members());
+                }
+                add_varint(m_versions, state.list);
+                break;
+            }
+            default:
+                break;
+        }
+    }
+
+    void decode_version(osmium::item_type type, const char** data, version_state& state) const {
+        const char* end = m_versions.data() + m_versions.size();
+        state.version += protozero::decode_zigzag64(protozero::decode_varint(data, end));
+        state.timestamp += protozero::decode_zigzag64(protozero::decode_varint(data, end));
+        const uint64_t tags = protozero::decode_varint(data, end);
+        state.visible = tags & 1U;
+        state.tags = static_cast<std::size_t>(tags >> 1U);
+
+        switch (type) {
+            case osmium::item_type::node:
+                state.x += protozero::decode_zigzag64(protozero::decode_varint(data, end));
+                state.y += protozero::decode_zigzag64(protozero::decode_varint(data, end));
+                break;
+            case osmium::item_type::way:
+            case osmium::item_type::relation:
+                state.list = static_cast<std::size_t>(protozero::decode_varint(data, end));
+                break;
+            default:
+                break;
+        }
+    }
+
+    const char* string(std::size_t offset) const noexcept {
+        return m_strings.data() + offset;
+    }
+
+    template <typename TBuilder>
+    void build_tags(TBuilder& parent, std::size_t offset) const {
+        const std::size_t num_tags = m_tags[offset];
+        if (num_tags == 0) {
+            return;
+        }
+        osmium::builder::TagListBuilder builder{parent};
+        for (std::size_t n = 0; n < num_tags; ++n) {
+            builder.add_tag(string(m_tags[offset + 1 + n * 2]), string(m_tags[offset + 2 + n * 2]));
+        }
+    }
+
+    template <typename TBuilder>
+    void build_object_attributes(TBuilder& builder, const object_entry& object, const version_state& state) const {
+        builder.set_id(object.id);
+        builder.set_version(static_cast<osmium::object_version_type>(state.version));
+        builder.set_timestamp(osmium::Timestamp{static_cast<uint32_t>(state.timestamp)});
+        builder.set_visible(true);
+    }
+
+    void build(const object_entry& object, const version_state& state, osmium::memory::Buffer& buffer) const {
+        const char* end = m_lists.data() + m_lists.size();
+
+        switch (object.type) {
+            case osmium::item_type::node: {
+                osmium::builder::NodeBuilder builder{buffer};
+                build_object_attributes(builder, object, state);
+                builder.set_location(osmium::Location{static_cast<int32_t>(state.x), static_cast<int32_t>(state.y)});
+                build_tags(builder, state.tags);
+                break;
+            }
+            case osmium::item_type::way: {
+                osmium::builder::WayBuilder builder{buffer};
+                build_object_attributes(builder, object, state);
+                build_tags(builder, state.tags);
+                osmium::builder::WayNodeListBuilder wnl_builder{builder};
+                const char* data = m_lists.data() + state.list;
+                const auto num_nodes = protozero::decode_varint(&data, end);
+                int64_t ref = 0;
+                for (uint64_t n = 0; n < num_nodes; ++n) {
+                    ref += protozero::decode_zigzag64(protozero::decode_varint(&data, end));
+                    wnl_builder.add_node_ref(ref);
+                }
+                break;
+            }
+            case osmium::item_type::relation: {
+                osmium::builder::RelationBuilder builder{buffer};
+                build_object_attributes(builder, object, state);
+                build_tags(builder, state.tags);
+                osmium::builder::RelationMemberListBuilder rml_builder{builder};
+                const char* data = m_lists.data() + state.list;
+                const auto num_members = protozero::decode_varint(&data, end);
+                int64_t ref = 0;
+                for (uint64_t n = 0; n < num_members; ++n) {
+                    const auto type = static_cast<osmium::item_type>(protozero::decode_varint(&data, end));
+                    ref += protozero::decode_zigzag64(protozero::decode_varint(&data, end));
+                    const auto role = static_cast<std::size_t>(protozero::decode_varint(&data, end));
+                    rml_builder.add_member(type, ref, string(role));
+                }
+                break;
+            }
+            default:
+                return;
+        }
+        buffer.commit();
+    }
+
+public:
+
+    using iterator = osmium::memory::Buffer::t_iterator<osmium::OSMObject>;
+
+    /**
+     * Build from history data which must be sorted by type, id, and
+     * version as usual.
+     */
+    CompactHistory(iterator begin, iterator end) {
+        const osmium::OSMObject* prev_object = nullptr;
+        version_state state;
+
+        for (auto it = begin; it != end; ++it) {
+            if (!prev_object || prev_object->type() != it->type() || prev_object->id() != it->id()) {
+                m_objects.push_back(object_entry{it->id(), m_versions.size(), 0, it->type()});
+                prev_object = nullptr;
+                state = version_state{};
+            }
+            add_version(prev_object, *it, state);
+            ++m_objects.back().num_versions;
+            prev_object = &*it;
+        }
+
+        m_string_index.clear();
+        m_string_index.rehash(0);
+        m_tags_index.clear();
+
+        m_objects.shrink_to_fit();
+        m_versions.shrink_to_fit();
+        m_strings.shrink_to_fit();
+        m_tags.shrink_to_fit();
+        m_lists.shrink_to_fit();
+    }
+
+    /**
+     * Copy all nodes and ways visible at point_in_time into fbuffer and
+     * all relations into rbuffer. Uses the same semantics as
+     * osmium::DiffObject::is_visible_at(): A version is visible from its
+     * timestamp until the timestamp of the next version. (This assumes
+     * the timestamps of the versions of an object never decrease.)
+     */
+    void snapshot(osmium::Timestamp point_in_time, osmium::memory::Buffer& fbuffer, osmium::memory::Buffer& rbuffer) const {
+        const auto t = static_cast<int64_t>(uint32_t(point_in_time));
+
+        for (const auto& object : m_objects) {
+            const char* data = m_versions.data() + object.offset;
+            version_state state;
+            version_state candidate;
+            bool found = false;
+
+            for (uint32_t n = 0; n < object.num_versions; ++n) {
+                decode_version(object.type, &data, state);
+                if (state.timestamp > t) {
+                    // The versions up to here are the only ones which could
+                    // be visible, because the next version starts too late.
+                    break;
+                }
+                candidate = state;
+                found = true;
+            }
+
+            if (found && candidate.visible) {
+                build(object, candidate, object.type == osmium::item_type::relation ? rbuffer : fbuffer);
+            }
+        }
+    }
+
+    std::size_t num_objects() const noexcept {
+        return m_objects.size();
+    }
+
+    std::size_t used_memory() const noexcept {
+        return m_objects.capacity() * sizeof(object_entry) +
+               m_versions.capacity() +
+               m_strings.capacity() +
+               m_tags.capacity() * sizeof(std::size_t) +
+               m_lists.capacity();
+    }
+
+}; // class CompactHistory
+
+#endif // COMPACT_HISTORY_HPP
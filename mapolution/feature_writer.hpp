@@ -0,0 +1,159 @@
+#ifndef FEATURE_WRITER_HPP
+#define FEATURE_WRITER_HPP
+
+// The code in this file is released into the Public Domain.
+
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include "gdalcpp.hpp"
+
+#include <osmium/thread/queue.hpp>
+
+/**
+ * The data for a feature: Its layer, geometry, and field values. The
+ * OGRFeature is only created in add_to_layer(), because that accesses
+ * the layer and its dataset. So the data can be created in one thread
+ * and written in another (see FeatureWriter) without both threads using
+ * the dataset.
+ */
+class FeatureData {
+
+    using field_value = std::variant<int, double, std::string>;
+
+    gdalcpp::Layer& m_layer;
+    std::unique_ptr<OGRGeometry> m_geometry;
+    std::vector<std::pair<std::string, field_value>> m_fields;
+
+public:
+
+    FeatureData(gdalcpp::Layer& layer, std::unique_ptr<OGRGeometry>&& geometry) :
+        m_layer(layer),
+        m_geometry(std::move(geometry)) {
+    }
+
+    template <typename T>
+    FeatureData& set_field(const char* name, T&& value) {
+        m_fields.emplace_back(name, field_value{std::forward<T>(value)});
+        return *this;
+    }
+
+    void add_to_layer() {
+        gdalcpp::Feature feature{m_layer, std::move(m_geometry)};
+        for (const auto& field : m_fields) {
+            std::visit([&feature, &field](const auto& value) {
+                if constexpr (std::is_same<std::decay_t<decltype(value)>, std::string>::value) {
+                    feature.set_field(field.first.c_str(), value.c_str());
+                } else {
+                    feature.set_field(field.first.c_str(), value);
+                }
+            }, field.second);
+        }
+        feature.add_to_layer();
+    }
+
+}; // class FeatureData
+
+/**
+ * Writes features into the layers of a dataset in a separate thread, so
+ * geometries can be created while the data is written to disk. Feature
+ * data is handed over through a queue with a maximum size, the features
+ * are created from it in the writer thread, so only that thread uses the
+ * dataset while the writer is open.
+ *
+ * If the dataset supports transactions, features are written in
+ * transactions of the given size.
+ *
+ * Call close() when done. Layers must not be accessed while the writer is
+ * still open.
+ */
+class FeatureWriter {
+
+    // Maximum number of features waiting in the queue
+    static constexpr const std::size_t max_queue_size = 10000;
+
+    using feature_ptr = std::unique_ptr<FeatureData>;
+
+    gdalcpp::Dataset& m_dataset;
+    osmium::thread::Queue<feature_ptr> m_queue{max_queue_size, "feature_writer"};
+    std::exception_ptr m_exception;
+    std::thread m_thread;
+
+    void run() {
+        while (true) {
+            feature_ptr feature;
+            m_queue.wait_and_pop(feature);
+            if (!feature) { // end marker
+                break;
+            }
+            // After an error, features are still taken from the queue
+            // (but not written), so nobody waits on a full queue.
+            if (!m_exception) {
+                try {
+                    feature->add_to_layer();
+                } catch (...) {
+                    m_exception = std::current_exception();
+                }
+            }
+        }
+
+        try {
+            m_dataset.disable_auto_transactions();
+        } catch (...) {
+            if (!m_exception) {
+                m_exception = std::current_exception();
+            }
+        }
+    }
+
+public:
+
+    FeatureWriter(gdalcpp::Dataset& dataset, uint64_t transaction_size) :
+        m_dataset(dataset) {
+        if (transaction_size > 0 && dataset.get().TestCapability(ODsCTransactions)) {
+            m_dataset.enable_auto_transactions(transaction_size);
+        }
+        m_thread = std::thread{&FeatureWriter::run, this};
+    }
+
+    FeatureWriter(const FeatureWriter&) = delete;
+    FeatureWriter& operator=(const FeatureWriter&) = delete;
+
+    FeatureWriter(FeatureWriter&&) = delete;
+    FeatureWriter& operator=(FeatureWriter&&) = delete;
+
+    ~FeatureWriter() {
+        try {
+            close();
+        } catch (...) {
+            // ignore exceptions in destructor
+        }
+    }
+
+    void add(feature_ptr&& feature) {
+        m_queue.push(std::move(feature));
+    }
+
+    // Wait for the writer thread to write all features and commit the
+    // last transaction. Throws if there was an error writing.
+    void close() {
+        if (!m_thread.joinable()) {
+            return;
+        }
+        m_queue.push(feature_ptr{});
+        m_thread.join();
+        if (m_exception) {
+            std::rethrow_exception(m_exception);
+        }
+    }
+
+}; // class FeatureWriter
+
+#endif // FEATURE_WRITER_HPP
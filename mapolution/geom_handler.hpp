@@ -4,6 +4,11 @@
 // The code in this file is released into the Public Domain.
 
 #include "gdalcpp.hpp"
+#include "feature_writer.hpp"
+#include "raster.hpp"
+
+#include <memory>
+#include <vector>
 
 #include <osmium/geom/ogr.hpp>
 #include <osmium/geom/mercator_projection.hpp>
@@ -21,6 +26,78 @@ private:
 
     gdalcpp::Dataset& m_dataset;
 
+    Raster* m_raster = nullptr;
+
+    // Create geometries directly instead of through the factory. This
+    // reuses the coordinate arrays and calculates the envelope while
+    // projecting the coordinates.
+    bool m_direct_geometry = true;
+    osmium::geom::MercatorProjection m_projection;
+    std::vector<double> m_xs;
+    std::vector<double> m_ys;
+
+    std::size_t m_count = 0;
+
+    // Project all locations into m_xs and m_ys, optionally removing
+    // consecutive duplicate locations, and add them to the envelope.
+    template <typename TNodeRefList>
+    void project(const TNodeRefList& nodes, bool unique, OGREnvelope& envelope) {
+        m_xs.clear();
+        m_ys.clear();
+        osmium::Location last;
+        for (const auto& node_ref : nodes) {
+            if (unique && last && node_ref.location() == last) {
+                continue;
+            }
+            last = node_ref.location();
+            const auto c = m_projection(last);
+            m_xs.push_back(c.x);
+            m_ys.push_back(c.y);
+            envelope.Merge(c.x, c.y);
+        }
+    }
+
+    template <typename TRing>
+    OGRLinearRing* create_ring(const TRing& ring) {
+        project(ring, false, m_envelope);
+        auto ogr_ring = std::make_unique<OGRLinearRing>();
+        ogr_ring->setPoints(static_cast<int>(m_xs.size()), m_xs.data(), m_ys.data());
+        return ogr_ring.release();
+    }
+
+    FeatureWriter* m_writer = nullptr;
+
+    void rasterize(const OGRPoint& point) {
+        m_raster->draw_point(m_raster->to_pixel(point.getX(), point.getY()));
+    }
+
+    void rasterize(const OGRLineString& linestring) {
+        for (int i = 1; i < linestring.getNumPoints(); ++i) {
+            m_raster->draw_line(m_raster->to_pixel(linestring.getX(i - 1), linestring.getY(i - 1)),
+                                m_raster->to_pixel(linestring.getX(i), linestring.getY(i)));
+        }
+    }
+
+    void rasterize(const OGRMultiPolygon& multipolygon) {
+        std::vector<std::vector<Raster::point>> rings;
+        const auto add_ring = [&](const OGRLinearRing& ring) {
+            rings.emplace_back();
+            for (int i = 0; i < ring.getNumPoints(); ++i) {
+                rings.back().push_back(m_raster->to_pixel(ring.getX(i), ring.getY(i)));
+            }
+        };
+
+        for (int p = 0; p < multipolygon.getNumGeometries(); ++p) {
+            const auto* polygon = static_cast<const OGRPolygon*>(multipolygon.getGeometryRef(p));
+            rings.clear();
+            add_ring(*polygon->getExteriorRing());
+            for (int r = 0; r < polygon->getNumInteriorRings(); ++r) {
+                add_ring(*polygon->getInteriorRing(r));
+            }
+            m_raster->fill_polygon(rings);
+        }
+    }
+
 public:
 
     GeomHandler(factory_type& factory, gdalcpp::Dataset& dataset) :
@@ -28,6 +105,24 @@ public:
         m_dataset(dataset) {
     }
 
+    GeomHandler(const GeomHandler&) = delete;
+    GeomHandler& operator=(const GeomHandler&) = delete;
+
+    GeomHandler(GeomHandler&&) = delete;
+    GeomHandler& operator=(GeomHandler&&) = delete;
+
+    virtual ~GeomHandler() = default;
+
+    // Override any of these in derived classes
+    virtual void node(const osmium::Node& /*node*/) {
+    }
+
+    virtual void way(const osmium::Way& /*way*/) {
+    }
+
+    virtual void area(const osmium::Area& /*area*/) {
+    }
+
     gdalcpp::Dataset& dataset() const {
         return m_dataset;
     }
@@ -36,27 +131,114 @@ public:
         return m_envelope;
     }
 
+    /**
+     * Also draw all geometries created into this raster.
+     */
+    void set_raster(Raster* raster) noexcept {
+        m_raster = raster;
+    }
+
+    /**
+     * Create geometries directly (true) or through the OGRFactory (false).
+     */
+    void set_direct_geometry(bool direct) noexcept {
+        m_direct_geometry = direct;
+    }
+
+    /**
+     * Number of geometries created.
+     */
+    std::size_t count() const noexcept {
+        return m_count;
+    }
+
+    /**
+     * Write features through this writer instead of directly.
+     */
+    void set_writer(FeatureWriter* writer) noexcept {
+        m_writer = writer;
+    }
+
+    /**
+     * Add feature to its layer. Use this instead of calling add_to_layer()
+     * on the feature.
+     */
+    void write(std::unique_ptr<FeatureData>&& feature) {
+        if (m_writer) {
+            m_writer->add(std::move(feature));
+        } else {
+            feature->add_to_layer();
+        }
+    }
+
     std::unique_ptr<OGRPoint> create_point(const osmium::Node& node) {
-        std::unique_ptr<OGRPoint> geom = m_factory.create_point(node);
-        OGREnvelope env;
-        geom->getEnvelope(&env);
-        m_envelope.Merge(env);
+        std::unique_ptr<OGRPoint> geom;
+        if (m_direct_geometry) {
+            const auto c = m_projection(node.location());
+            geom = std::make_unique<OGRPoint>(c.x, c.y);
+            m_envelope.Merge(c.x, c.y);
+        } else {
+            geom = m_factory.create_point(node);
+            OGREnvelope env;
+            geom->getEnvelope(&env);
+            m_envelope.Merge(env);
+        }
+        ++m_count;
+        if (m_raster) {
+            rasterize(*geom);
+        }
         return geom;
     }
 
     std::unique_ptr<OGRLineString> create_linestring(const osmium::Way& way) {
-        std::unique_ptr<OGRLineString> geom = m_factory.create_linestring(way);
-        OGREnvelope env;
-        geom->getEnvelope(&env);
-        m_envelope.Merge(env);
+        std::unique_ptr<OGRLineString> geom;
+        if (m_direct_geometry) {
+            OGREnvelope env;
+            project(way.nodes(), true, env);
+            if (m_xs.size() < 2) {
+                throw osmium::geometry_error{"need at least two points for linestring", "way", way.id()};
+            }
+            geom = std::make_unique<OGRLineString>();
+            geom->setPoints(static_cast<int>(m_xs.size()), m_xs.data(), m_ys.data());
+            m_envelope.Merge(env);
+        } else {
+            geom = m_factory.create_linestring(way);
+            OGREnvelope env;
+            geom->getEnvelope(&env);
+            m_envelope.Merge(env);
+        }
+        ++m_count;
+        if (m_raster) {
+            rasterize(*geom);
+        }
         return geom;
     }
 
     std::unique_ptr<OGRMultiPolygon> create_multipolygon(const osmium::Area& area) {
-        std::unique_ptr<OGRMultiPolygon> geom = m_factory.create_multipolygon(area);
-        OGREnvelope env;
-        geom->getEnvelope(&env);
-        m_envelope.Merge(env);
+        std::unique_ptr<OGRMultiPolygon> geom;
+        if (m_direct_geometry) {
+            geom = std::make_unique<OGRMultiPolygon>();
+            for (const auto& outer : area.outer_rings()) {
+                auto polygon = std::make_unique<OGRPolygon>();
+                polygon->addRingDirectly(create_ring(outer));
+                for (const auto& inner : area.inner_rings(outer)) {
+                    polygon->addRingDirectly(create_ring(inner));
+                }
+                geom->addGeometryDirectly(polygon.release());
+            }
+            if (geom->getNumGeometries() == 0) {
+                throw osmium::geometry_error{"area contains no rings", "area", area.id()};
+            }
+        } else {
+            geom = m_factory.create_multipolygon(area);
+            OGREnvelope env;
+            geom->getEnvelope(&env);
+            m_envelope.Merge(env);
+        }
+        ++m_count;
+        if (m_raster) {
+            rasterize(*geom);
+        }
         return geom;
     }
 
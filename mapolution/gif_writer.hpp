@@ -0,0 +1,213 @@
+#ifndef GIF_WRITER_HPP
+#define GIF_WRITER_HPP
+
+// The code in this file is released into the Public Domain.
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+/**
+ * Writes an animated GIF with two colors (black background and a
+ * foreground color) from a sequence of one-bit images. Frames are encoded
+ * (LZW compressed) with encode_frame() which can be called from several
+ * threads at the same time. The encoded frames are then written with
+ * write().
+ */
+class GifWriter {
+
+    // GIF needs at least 2 bits here, even for two colors
+    static constexpr const int min_code_size = 2;
+    static constexpr const int alphabet_size = 1 << min_code_size;
+    static constexpr const int clear_code = alphabet_size;
+    static constexpr const int end_code = clear_code + 1;
+    static constexpr const int max_code = 4095;
+
+    int m_width;
+    int m_height;
+    int m_delay;
+    uint8_t m_red;
+    uint8_t m_green;
+    uint8_t m_blue;
+
+    static void add_uint16(std::string& out, int value) {
+        out += static_cast<char>(value & 0xff);
+        out += static_cast<char>((value >> 8) & 0xff);
+    }
+
+    // Collects variable length codes into bytes (least significant bit
+    // first) and the bytes into data sub-blocks of at most 255 bytes.
+    class CodeWriter {
+
+        std::string& m_out;
+        std::string m_block;
+        uint32_t m_bits = 0;
+        int m_num_bits = 0;
+
+        void add_byte(uint8_t byte) {
+            m_block += static_cast<char>(byte);
+            if (m_block.size() == 255) {
+                flush_block();
+            }
+        }
+
+        void flush_block() {
+            if (!m_block.empty()) {
+                m_out += static_cast<char>(m_block.size());
+                m_out += m_block;
+                m_block.clear();
+            }
+        }
+
+    public:
+
+        explicit CodeWriter(std::string& out) :
+            m_out(out) {
+        }
+
+        void write(int code, int code_size) {
+            m_bits |= static_cast<uint32_t>(code) << m_num_bits;
+            m_num_bits += code_size;
+            while (m_num_bits >= 8) {
+                add_byte(static_cast<uint8_t>(m_bits & 0xffU));
+                m_bits >>= 8U;
+                m_num_bits -= 8;
+            }
+        }
+
+        void finish() {
+            if (m_num_bits > 0) {
+                add_byte(static_cast<uint8_t>(m_bits & 0xffU));
+            }
+            flush_block();
+            m_out += '\0'; // block terminator
+        }
+
+    }; // class CodeWriter
+
+public:
+
+    /**
+     * Create writer for images of the given size. The delay between
+     * frames is in hundredths of a second.
+     */
+    GifWriter(int width, int height, int delay, uint8_t red, uint8_t green, uint8_t blue) :
+        m_width(width),
+        m_height(height),
+        m_delay(delay),
+        m_red(red),
+        m_green(green),
+        m_blue(blue) {
+    }
+
+    /**
+     * Encode one frame. The pixels must have values 0 (background) or 1
+     * (foreground). Returns the frame as it is written into the file.
+     */
+    std::string encode_frame(const std::vector<uint8_t>& pixels) const {
+        std::string out;
+
+        // Graphic control extension with delay
+        out += "\x21\xf9\x04";
+        out += '\0';
+        add_uint16(out, m_delay);
+        out += '\0'; // transparent color index (not used)
+        out += '\0';
+
+        // Image descriptor
+        out += '\x2c';
+        add_uint16(out, 0);
+        add_uint16(out, 0);
+        add_uint16(out, m_width);
+        add_uint16(out, m_height);
+        out += '\0'; // no local color table
+
+        out += static_cast<char>(min_code_size);
+
+        // LZW compression. The string table is stored as a tree: The code
+        // for the string made of the string with code c plus pixel value
+        // p is in table[c * alphabet_size + p] (or 0 if not in the table).
+        CodeWriter writer{out};
+        std::vector<uint16_t> table(static_cast<std::size_t>(max_code + 1) * alphabet_size, 0);
+        int code_size = min_code_size + 1;
+        int next_code = end_code + 1;
+
+        writer.write(clear_code, code_size);
+
+        if (!pixels.empty()) {
+            int current = pixels[0];
+            for (std::size_t i = 1; i < pixels.size(); ++i) {
+                const int pixel = pixels[i];
+                uint16_t& entry = table[static_cast<std::size_t>(current) * alphabet_size + pixel];
+                if (entry) {
+                    current = entry;
+                    continue;
+                }
+
+                writer.write(current, code_size);
+                entry = static_cast<uint16_t>(next_code);
+                if (next_code == (1 << code_size)) {
+                    ++code_size;
+                }
+                ++next_code;
+
+                if (next_code > max_code) {
+                    writer.write(clear_code, code_size);
+                    std::fill(table.begin(), table.end(), 0);
+                    code_size = min_code_size + 1;
+                    next_code = end_code + 1;
+                }
+
+                current = pixel;
+            }
+            writer.write(current, code_size);
+        }
+
+        writer.write(end_code, code_size);
+        writer.finish();
+
+        return out;
+    }
+
+    /**
+     * Write file with all the frames (as returned by encode_frame()) which
+     * is shown in an endless loop.
+     */
+    void write(const std::string& filename, const std::vector<std::string>& frames) const {
+        std::string header{"GIF89a"};
+        add_uint16(header, m_width);
+        add_uint16(header, m_height);
+        header += '\x80'; // global color table with two entries
+        header += '\0';   // background color index
+        header += '\0';   // pixel aspect ratio
+
+        header += '\0'; // color 0: black
+        header += '\0';
+        header += '\0';
+        header += static_cast<char>(m_red); // color 1: foreground
+        header += static_cast<char>(m_green);
+        header += static_cast<char>(m_blue);
+
+        // Netscape application extension: loop forever
+        header += "\x21\xff\x0bNETSCAPE2.0\x03\x01";
+        add_uint16(header, 0);
+        header += '\0';
+
+        std::ofstream out{filename, std::ofstream::binary};
+        out << header;
+        for (const auto& frame : frames) {
+            out << frame;
+        }
+        out << '\x3b'; // trailer
+        out.close();
+        if (!out) {
+            throw std::runtime_error{"Error writing GIF file '" + filename + "'"};
+        }
+    }
+
+}; // class GifWriter
+
+#endif // GIF_WRITER_HPP
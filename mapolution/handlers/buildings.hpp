@@ -13,19 +13,19 @@ public:
         m_layer.add_field("id", OFTInteger, 10);
     }
 
-    ~BuildingsHandler() {
+    ~BuildingsHandler() override {
         if (m_layer.get().GetFeatureCount() == 0) {
             std::cerr << "WARNING: No features in layer '" << m_layer.get().GetName() << "'.\n";
         }
     }
 
-    void area(const osmium::Area& area) {
+    void area(const osmium::Area& area) override {
         try {
             const char* building = area.tags()["building"];
             if (building) {
-                gdalcpp::Feature f(m_layer, create_multipolygon(area));
-                f.set_field("id", static_cast<int>(area.id()));
-                f.add_to_layer();
+                auto feature = std::make_unique<FeatureData>(m_layer, create_multipolygon(area));
+                feature->set_field("id", static_cast<int>(area.id()));
+                write(std::move(feature));
             }
         } catch (osmium::not_found&) {
             // ignore missing node locations
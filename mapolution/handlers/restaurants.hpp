@@ -13,13 +13,13 @@ public:
         m_layer.add_field("id", OFTReal, 10);
     }
 
-    void node(const osmium::Node& node) {
+    void node(const osmium::Node& node) override {
         try {
             const char* amenity = node.tags()["amenity"];
             if (amenity && !strcmp(amenity, "restaurant")) {
-                gdalcpp::Feature f(m_layer, create_point(node));
-                f.set_field("id", static_cast<double>(node.id()));
-                f.add_to_layer();
+                auto feature = std::make_unique<FeatureData>(m_layer, create_point(node));
+                feature->set_field("id", static_cast<double>(node.id()));
+                write(std::move(feature));
             }
         } catch (osmium::not_found&) {
             // ignore missing node locations
@@ -35,9 +35,9 @@ public:
         try {
             const char* amenity = area.tags()["amenity"];
             if (amenity && !strcmp(amenity, "restaurant")) {
-                gdalcpp::Feature f(m_layer, create_point(area.)); // get one node XXX
-                f.set_field("id", static_cast<int>(area.id()));
-                f.add_to_layer();
+                auto feature = std::make_unique<FeatureData>(m_layer, create_point(area.)); // get one node XXX
+                feature->set_field("id", static_cast<int>(area.id()));
+                write(std::move(feature));
             }
         } catch (osmium::not_found&) {
             // ignore missing node locations
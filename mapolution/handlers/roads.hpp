@@ -14,14 +14,14 @@ public:
         m_layer.add_field("type", OFTString, 30);
     }
 
-    void way(const osmium::Way& way) {
+    void way(const osmium::Way& way) override {
         try {
             const char* highway = way.tags()["highway"];
             if (highway) {
-                gdalcpp::Feature f(m_layer, create_linestring(way));
-                f.set_field("id", static_cast<int>(way.id()));
-                f.set_field("type", highway);
-                f.add_to_layer();
+                auto feature = std::make_unique<FeatureData>(m_layer, create_linestring(way));
+                feature->set_field("id", static_cast<int>(way.id()));
+                feature->set_field("type", highway);
+                write(std::move(feature));
             }
         } catch (osmium::not_found&) {
             // ignore missing node locations
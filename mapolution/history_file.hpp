@@ -0,0 +1,179 @@
+#ifndef HISTORY_FILE_HPP
+#define HISTORY_FILE_HPP
+
+// The code in this file is released into the Public Domain.
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <stdexcept>
+#include <string>
+
+#include <unistd.h>
+
+#include <osmium/io/detail/read_write.hpp>
+#include <osmium/io/writer_options.hpp>
+#include <osmium/memory/buffer.hpp>
+#include <osmium/util/file.hpp>
+#include <osmium/util/memory_mapping.hpp>
+
+/**
+ * The history data in the same format libosmium uses for buffers in
+ * memory, stored in a file which is mapped into memory when needed. This
+ * way the data is held in the page cache instead of on the heap and
+ * doesn't need to fit into memory completely.
+ *
+ * The file starts with a header: A magic string, the format version, the
+ * size of the key and the data, and the key itself (padded to a multiple
+ * of 8 bytes so the data is aligned). The key describes where the data
+ * came from (input file, filter options). The file can only be used with
+ * the same key it was created with.
+ */
+class HistoryFile {
+
+    static constexpr const char* magic = "MAPOLHST";
+    static constexpr const std::size_t magic_size = 8;
+    static constexpr const uint32_t format_version = 1;
+
+    // magic, version, key size, data size
+    static constexpr const std::size_t fixed_header_size = magic_size + 4 + 4 + 8;
+
+    osmium::util::MemoryMapping m_mapping;
+    osmium::memory::Buffer m_buffer;
+
+    static std::size_t padded_key_size(std::size_t key_size) noexcept {
+        return (key_size + 7U) & ~std::size_t{7U};
+    }
+
+    static std::string make_header(const std::string& key, uint64_t data_size) {
+        std::string header(fixed_header_size + padded_key_size(key.size()), '\0');
+        const auto key_size = static_cast<uint32_t>(key.size());
+        std::memcpy(&header[0], magic, magic_size);
+        std::memcpy(&header[magic_size], &format_version, 4);
+        std::memcpy(&header[magic_size + 4], &key_size, 4);
+        std::memcpy(&header[magic_size + 8], &data_size, 8);
+        std::memcpy(&header[fixed_header_size], key.data(), key.size());
+        return header;
+    }
+
+    // Check the header and return its size.
+    static std::size_t check_header(const std::string& filename, const char* data, std::size_t size, const std::string& key) {
+        if (size < fixed_header_size || std::memcmp(data, magic, magic_size) != 0) {
+            throw std::runtime_error{"File '" + filename + "' is not a history file"};
+        }
+
+        uint32_t version = 0;
+        uint32_t key_size = 0;
+        uint64_t data_size = 0;
+        std::memcpy(&version, data + magic_size, 4);
+        std::memcpy(&key_size, data + magic_size + 4, 4);
+        std::memcpy(&data_size, data + magic_size + 8, 8);
+
+        if (version != format_version) {
+            throw std::runtime_error{"History file '" + filename + "' has unsupported format version " + std::to_string(version) + ". Delete it to create it again."};
+        }
+
+        const std::size_t header_size = fixed_header_size + padded_key_size(key_size);
+        if (header_size > size || size - header_size != data_size ||
+            data_size % osmium::memory::align_bytes != 0) {
+            throw std::runtime_error{"History file '" + filename + "' is truncated or damaged. Delete it to create it again."};
+        }
+
+        if (key != std::string(data + fixed_header_size, key_size)) {
+            throw std::runtime_error{"History file '" + filename + "' was created from a different input file or with different filter options. Delete it to create it again."};
+        }
+
+        return header_size;
+    }
+
+    static osmium::util::MemoryMapping map_file(const std::string& filename) {
+        const int fd = osmium::io::detail::open_for_reading(filename);
+        const std::size_t size = osmium::util::file_size(fd);
+        if (size == 0) {
+            osmium::io::detail::reliable_close(fd);
+            throw std::runtime_error{"History file '" + filename + "' is empty"};
+        }
+
+        // The mapping is private so nothing we do in memory will ever be
+        // written back to the file. The file descriptor can be closed once
+        // the mapping exists.
+        osmium::util::MemoryMapping mapping{size, osmium::util::MemoryMapping::mapping_mode::write_private, fd};
+        osmium::io::detail::reliable_close(fd);
+        return mapping;
+    }
+
+public:
+
+    using callback_type = std::function<void(const osmium::memory::Buffer&)>;
+
+    // A function calling the callback with each buffer of input data
+    using read_function_type = std::function<void(const callback_type&)>;
+
+    /**
+     * Write all buffers the read function gives us (usually read from an
+     * input file) into the history file. Only one buffer of input data is
+     * in memory at any time. The data is written into a temporary file
+     * first which is renamed when done, so there is never an incomplete
+     * history file. The temporary file is removed if there is an error.
+     */
+    static void create(const std::string& filename, const std::string& key, const read_function_type& read_function) {
+        const std::string tmp_filename{filename + ".tmp"};
+        const int fd = osmium::io::detail::open_for_writing(tmp_filename, osmium::io::overwrite::allow);
+
+        try {
+            // The header is written again with the data size at the end.
+            std::string header{make_header(key, 0)};
+            osmium::io::detail::reliable_write(fd, header.data(), header.size());
+
+            uint64_t data_size = 0;
+            read_function([fd, &data_size](const osmium::memory::Buffer& buffer) {
+                osmium::io::detail::reliable_write(fd, buffer.data(), buffer.committed());
+                data_size += buffer.committed();
+            });
+
+            header = make_header(key, data_size);
+            if (::lseek(fd, 0, SEEK_SET) != 0) {
+                throw std::runtime_error{"Can not write header of history file '" + tmp_filename + "'"};
+            }
+            osmium::io::detail::reliable_write(fd, header.data(), header.size());
+            osmium::io::detail::reliable_close(fd);
+        } catch (...) {
+            ::close(fd); // might be closed already, ignore errors
+            std::remove(tmp_filename.c_str());
+            throw;
+        }
+
+        std::filesystem::rename(tmp_filename, filename);
+    }
+
+    /**
+     * Map the history file into memory. Throws std::runtime_error if it
+     * isn't a history file or was created with a different key.
+     */
+    HistoryFile(const std::string& filename, const std::string& key) :
+        m_mapping(map_file(filename)) {
+        const std::size_t header_size = check_header(filename, m_mapping.get_addr<char>(), m_mapping.size(), key);
+        m_buffer = osmium::memory::Buffer{m_mapping.get_addr<unsigned char>() + header_size, m_mapping.size() - header_size};
+    }
+
+    HistoryFile(const HistoryFile&) = delete;
+    HistoryFile& operator=(const HistoryFile&) = delete;
+
+    HistoryFile(HistoryFile&&) = delete;
+    HistoryFile& operator=(HistoryFile&&) = delete;
+
+    ~HistoryFile() = default;
+
+    /**
+     * A buffer with all the data in the file. It doesn't own the memory
+     * and is only valid as long as this object exists.
+     */
+    osmium::memory::Buffer& buffer() noexcept {
+        return m_buffer;
+    }
+
+}; // class HistoryFile
+
+#endif // HISTORY_FILE_HPP
@@ -1,45 +1,64 @@
 
 // The code in this file is released into the Public Domain.
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
 #include <numeric>
 #include <filesystem>
 #include <fstream>
+#include <future>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <vector>
 
 #include <osmium/area/assembler_legacy.hpp>
 #include <osmium/area/multipolygon_manager_legacy.hpp>
 #include <osmium/diff_iterator.hpp>
+#include <osmium/geom/mercator_projection.hpp>
 #include <osmium/handler.hpp>
 #include <osmium/io/any_input.hpp>
+#include <osmium/osm/box.hpp>
 #include <osmium/visitor.hpp>
 
-#include <osmium/index/map/flex_mem.hpp>
-#include <osmium/handler/node_locations_for_ways.hpp>
-using index_type = osmium::index::map::FlexMem<osmium::unsigned_object_id_type, osmium::Location>;
-using location_handler_type = osmium::handler::NodeLocationsForWays<index_type>;
-
+#include "area_cache.hpp"
 #include "cmdline_options.hpp"
+#include "compact_history.hpp"
+#include "feature_writer.hpp"
 #include "geom_handler.hpp"
+#include "gif_writer.hpp"
+#include "history_file.hpp"
+#include "multi_handler.hpp"
+#include "prefilter.hpp"
+#include "raster.hpp"
+#include "run_stats.hpp"
+#include "temporal_output.hpp"
+#include "timeline.hpp"
+#include "versioned_locations.hpp"
 
-#include "handlers/buildings.hpp"
-#include "handlers/restaurants.hpp"
-#include "handlers/roads.hpp"
 
 constexpr size_t initial_buffer_size = 10 * 1024 * 1024;
 
-OGREnvelope extract(
-        Options& options,
-        osmium::geom::OGRFactory<osmium::geom::MercatorProjection>& factory,
+/**
+ * Copy all objects visible at point_in_time into fbuffer (nodes and ways)
+ * and rbuffer (relations). This goes through the whole history.
+ */
+void filter_history(
         osmium::memory::Buffer::t_iterator<osmium::OSMObject> begin,
         osmium::memory::Buffer::t_iterator<osmium::OSMObject> relations,
         osmium::memory::Buffer::t_iterator<osmium::OSMObject> end,
-        osmium::Timestamp point_in_time) {
+        osmium::Timestamp point_in_time,
+        osmium::memory::Buffer& fbuffer,
+        osmium::memory::Buffer& rbuffer) {
 
-    options.vout << "Working on " << point_in_time << "...\n";
-    options.vout << "  Filtering data...\n";
+    using diff_iterator = osmium::DiffIterator<osmium::memory::Buffer::t_iterator<osmium::OSMObject>>;
 
     // nodes and ways
-    using diff_iterator = osmium::DiffIterator<osmium::memory::Buffer::t_iterator<osmium::OSMObject>>;
-    osmium::memory::Buffer fbuffer{initial_buffer_size, osmium::memory::Buffer::auto_grow::yes};
     {
         const diff_iterator dbegin{begin, relations};
         const diff_iterator dend{relations, relations};
@@ -51,12 +70,8 @@ OGREnvelope extract(
             }
         });
     }
-    options.vout << "  Done. Filtered data needs "
-                 << (fbuffer.committed() / (1024 * 1024))
-                 << " MBytes.\n";
 
     // relations
-    osmium::memory::Buffer rbuffer(initial_buffer_size, osmium::memory::Buffer::auto_grow::yes);
     {
         const diff_iterator dbegin{relations, end};
         const diff_iterator dend{end, end};
@@ -68,39 +83,74 @@ OGREnvelope extract(
             }
         });
     }
+}
 
-    osmium::area::AssemblerLegacy::config_type assembler_config;
-    osmium::area::MultipolygonManagerLegacy<osmium::area::AssemblerLegacy> mp_manager{assembler_config};
-
-    options.vout << "  Reading relations...\n";
-    osmium::apply(rbuffer, mp_manager);
-    mp_manager.prepare_for_lookup();
+OGREnvelope extract(
+        Options& options,
+        RunStats& stats,
+        osmium::geom::OGRFactory<osmium::geom::MercatorProjection>& factory,
+        const VersionedLocations& locations,
+        AreaCache& area_cache,
+        osmium::memory::Buffer& fbuffer,
+        osmium::memory::Buffer& rbuffer,
+        osmium::Timestamp point_in_time,
+        Raster* raster,
+        TemporalOutput* temporal,
+        std::size_t step,
+        bool progress) {
+
+    // Only areas which changed since the last time step are assembled,
+    // all others are taken from the cache.
+    using assembler_type = CachingAssembler<osmium::area::AssemblerLegacy>;
+    assembler_type::config_type assembler_config;
+    assembler_config.cache = &area_cache;
+    osmium::area::MultipolygonManagerLegacy<assembler_type> mp_manager{assembler_config};
+
+    if (progress) {
+        options.vout << "  Reading relations...\n";
+    }
+    {
+        const auto phase = stats.phase("read_relations");
+        osmium::apply(rbuffer, mp_manager);
+        mp_manager.prepare_for_lookup();
+    }
 
-    index_type index_pos;
-    location_handler_type location_handler(index_pos);
-    location_handler.ignore_errors();
+    // No need to build a location index for each point in time, the
+    // locations of all node versions are already known.
+    VersionedLocationsForWays location_handler{locations, point_in_time};
 
-    options.vout << "  Creating geometries...\n";
+    if (progress) {
+        options.vout << "  Creating geometries...\n";
+    }
     const std::string date = point_in_time.to_iso().substr(0, 10);
 
     std::vector<std::string> datasource_options;
     std::string datasource_name{options.output_directory + "/" + date};
-    if (options.output_format == "GeoJSON") {
+    std::string output_format{options.output_format};
+    if (raster || temporal) {
+        // Geometries only go into the raster or the temporal output, don't
+        // write them anywhere here
+        output_format = "Memory";
+    } else if (options.output_format == "GeoJSON") {
         datasource_name += ".json";
     } else if (options.output_format == "SQLite") {
         datasource_name += ".db";
         datasource_options.push_back("SPATIALITE=TRUE");
-        CPLSetConfigOption("OGR_SQLITE_SYNCHRONOUS", "FALSE");
-        CPLSetConfigOption("OGR_SQLITE_CACHE", "512");
     }
 
-    gdalcpp::Dataset dataset{options.output_format, datasource_name, gdalcpp::SRS{factory.proj_string()}, datasource_options};
+    gdalcpp::Dataset dataset{output_format, datasource_name, gdalcpp::SRS{factory.proj_string()}, datasource_options};
 
-#ifdef HANDLER
-    HANDLER geom_handler{factory, dataset, date};
-#else
-    BuildingsHandler geom_handler{factory, dataset, date};
-#endif
+    MultiHandler geom_handler{options.handlers, factory, dataset, date};
+    geom_handler.set_raster(raster);
+    geom_handler.set_direct_geometry(options.geometry_path == "direct");
+
+    // Features are written in their own thread. This must be closed before
+    // the handlers are destroyed.
+    FeatureWriter writer{dataset, options.transaction_size};
+    geom_handler.set_writer(&writer);
+
+    const auto start = std::chrono::steady_clock::now();
+    auto geometries_phase = stats.phase("create_geometries");
     osmium::apply(fbuffer.begin(),
                   fbuffer.end(),
                   location_handler,
@@ -108,6 +158,35 @@ OGREnvelope extract(
                   mp_manager.handler([&geom_handler](const osmium::memory::Buffer& buffer) {
         osmium::apply(buffer, geom_handler);
     }));
+    geometries_phase.stop();
+
+    {
+        // Wait for the writer thread to write the remaining features
+        const auto phase = stats.phase("write_features");
+        writer.close();
+    }
+    stats.add("geometries", geom_handler.count());
+
+    if (progress) {
+        const std::chrono::duration<double> duration = std::chrono::steady_clock::now() - start;
+        options.vout << "  Created " << geom_handler.count() << " geometries ("
+                     << static_cast<uint64_t>(geom_handler.count() / std::max(duration.count(), 0.001))
+                     << " per second).\n";
+    }
+
+    if (temporal) {
+        const auto phase = stats.phase("temporal_output");
+        temporal->add(step, date, TemporalOutput::take_snapshot(dataset, date));
+    }
+
+    if (progress) {
+        options.vout << "  Reused " << area_cache.hits() << " of "
+                     << (area_cache.hits() + area_cache.misses())
+                     << " areas from last time step.\n";
+    }
+    stats.add("areas_reused", area_cache.hits());
+    stats.add("areas_assembled", area_cache.misses());
+    area_cache.next_step();
 
     return geom_handler.envelope();
 }
@@ -156,6 +235,52 @@ osmium::Timestamp day_start(const osmium::Timestamp& timestamp) {
     return osmium::Timestamp{time};
 }
 
+// Describes a file by name, size, and modification time, so we notice if
+// it changes. Missing files are described by their name only.
+std::string file_description(const std::string& filename) {
+    std::error_code ec;
+    const auto path = std::filesystem::absolute(filename, ec);
+    std::string description{ec ? filename : path.string()};
+
+    const auto size = std::filesystem::file_size(filename, ec);
+    if (!ec) {
+        description += " size=" + std::to_string(size);
+    }
+    const auto mtime = std::filesystem::last_write_time(filename, ec);
+    if (!ec) {
+        description += " mtime=" + std::to_string(mtime.time_since_epoch().count());
+    }
+    return description;
+}
+
+// The key stored in the history file. It describes the input the history
+// file was created from and the prefilter options, it can only be used
+// with the same input and options.
+std::string history_file_key(const Options& options) {
+    std::string key{"input=" + file_description(options.input_filename) + "\n"};
+    key += "format=" + options.input_format + "\n";
+
+    if (options.bbox.valid()) {
+        key += "bbox=" + std::to_string(options.bbox.bottom_left().x()) + ',' +
+                         std::to_string(options.bbox.bottom_left().y()) + ',' +
+                         std::to_string(options.bbox.top_right().x()) + ',' +
+                         std::to_string(options.bbox.top_right().y()) + "\n";
+    }
+    if (!options.polygon_file.empty()) {
+        key += "polygon=" + file_description(options.polygon_file) + "\n";
+    }
+    // With tag filtering the data kept depends on the handlers.
+    if (options.filter_tags) {
+        key += "filter-tags=";
+        for (const auto& name : options.handlers) {
+            key += name + ',';
+        }
+        key += "\n";
+    }
+
+    return key;
+}
+
 int main(int argc, char* argv[]) {
     Options options(argc, argv);
 
@@ -166,6 +291,9 @@ int main(int argc, char* argv[]) {
     }
     options.vout << "  Output directory:            " << options.output_directory << "\n";
     options.vout << "  Output OGR format:           " << options.output_format << "\n";
+    if (!options.history_file.empty()) {
+        options.vout << "  History file:                " << options.history_file << "\n";
+    }
     if (options.start_time) {
         options.vout << "  Start time:                  " << options.start_time << "\n";
     }
@@ -173,17 +301,102 @@ int main(int argc, char* argv[]) {
         options.vout << "  End time:                    " << options.end_time << "\n";
     }
     options.vout << "  Time steps:                  " << options.time_step << " day(s)\n";
+    options.vout << "  Handlers:                   ";
+    for (const auto& name : options.handlers) {
+        options.vout << ' ' << name;
+    }
+    options.vout << "\n";
+    if (options.bbox.valid()) {
+        options.vout << "  Bounding box:                " << options.bbox << "\n";
+    }
+    if (!options.polygon_file.empty()) {
+        options.vout << "  Polygon file:                " << options.polygon_file << "\n";
+    }
+    options.vout << "  Filter tags:                 " << (options.filter_tags ? "yes" : "no") << "\n";
+    options.vout << "  Sweep mode:                  " << (options.sweep ? "yes" : "no") << "\n";
+    options.vout << "  Compact history:             " << (options.compact ? "yes" : "no") << "\n";
+    options.vout << "  Area cache:                  " << (options.area_cache ? "yes" : "no") << "\n";
+    options.vout << "  Temporal output:             " << (options.temporal ? "yes" : "no") << "\n";
+    options.vout << "  Threads:                     " << options.threads << "\n";
+    options.vout << "  Transaction size:            " << options.transaction_size << "\n";
+    options.vout << "  Geometry path:               " << options.geometry_path << "\n";
+    if (!options.animation_file.empty()) {
+        options.vout << "  Animation file:              " << options.animation_file << "\n";
+        options.vout << "  Animation width:             " << options.width << "\n";
+        options.vout << "  Animation delay:             " << options.delay << "\n";
+    }
 
     if (options.start_time && options.end_time && options.start_time > options.end_time) {
         options.vout << "Your end time is before the start time. Switching them around.\n";
         std::swap(options.start_time, options.end_time);
     }
 
+    for (const auto& name : options.handlers) {
+        if (handler_registry().count(name) == 0) {
+            std::cerr << "Unknown handler '" << name << "'. Available handlers:";
+            for (const auto& handler : handler_registry()) {
+                std::cerr << ' ' << handler.first;
+            }
+            std::cerr << "\n";
+            std::exit(return_code::fatal);
+        }
+    }
+
     check_and_create_directory(options.output_directory);
 
-    options.vout << "Reading input file into memory...\n";
+    RunStats stats{"mapolution"};
+
     osmium::io::File file{options.input_filename, options.input_format};
-    osmium::memory::Buffer ibuffer{osmium::io::read_file(file, osmium::osm_entity_bits::object)};
+
+    // Reads the input file calling the callback for each buffer, either
+    // directly or through the prefilter.
+    HistoryFile::read_function_type read_input = [&file](const HistoryFile::callback_type& callback) {
+        osmium::io::Reader reader{file, osmium::osm_entity_bits::object};
+        while (osmium::memory::Buffer buffer = reader.read()) {
+            callback(buffer);
+        }
+        reader.close();
+    };
+
+    if (options.bbox.valid() || !options.polygon_file.empty() || options.filter_tags) {
+        read_input = [&options, &file](const HistoryFile::callback_type& callback) {
+            std::vector<const handler_info*> infos;
+            for (const auto& name : options.handlers) {
+                infos.push_back(&handler_registry().at(name));
+            }
+            Prefilter prefilter{options.bbox, options.polygon_file, options.filter_tags, infos};
+            prefilter.apply(file, callback);
+            options.vout << "Prefilter needed " << (prefilter.used_memory() / (1024 * 1024)) << " MBytes.\n";
+        };
+    }
+
+    auto read_phase = stats.phase("read_input");
+    osmium::memory::Buffer input_buffer;
+    std::unique_ptr<HistoryFile> history_file;
+    try {
+        if (options.history_file.empty()) {
+            options.vout << "Reading input file into memory...\n";
+            input_buffer = osmium::memory::Buffer{initial_buffer_size, osmium::memory::Buffer::auto_grow::yes};
+            read_input([&input_buffer](const osmium::memory::Buffer& buffer) {
+                input_buffer.add_buffer(buffer);
+                input_buffer.commit();
+            });
+        } else {
+            const std::string key{history_file_key(options)};
+            if (!std::filesystem::exists(options.history_file)) {
+                options.vout << "Writing history file...\n";
+                HistoryFile::create(options.history_file, key, read_input);
+            }
+            options.vout << "Mapping history file into memory...\n";
+            history_file = std::make_unique<HistoryFile>(options.history_file, key);
+        }
+    } catch (const std::runtime_error& e) {
+        std::cerr << e.what() << "\n";
+        std::exit(return_code::fatal);
+    }
+    osmium::memory::Buffer& ibuffer = history_file ? history_file->buffer() : input_buffer;
+    read_phase.stop();
+    stats.add("input_objects", static_cast<uint64_t>(std::distance(ibuffer.begin<osmium::OSMObject>(), ibuffer.end<osmium::OSMObject>())));
     options.vout << "Done. Input data needs " << (ibuffer.committed() / (1024 * 1024)) << " MBytes.\n";
 
     const auto first_relation = std::find_if(ibuffer.begin<osmium::OSMObject>(),
@@ -211,21 +424,197 @@ int main(int argc, char* argv[]) {
     options.vout << "Start time: " << start_time << "\n";
     options.vout << "End time  : " << end_time << "\n";
 
-    osmium::geom::OGRFactory<osmium::geom::MercatorProjection> factory{osmium::geom::MercatorProjection{}};
+    options.vout << "Building node location index...\n";
+    auto index_phase = stats.phase("build_location_index");
+    const VersionedLocations locations{ibuffer.begin<osmium::OSMObject>(), first_relation};
+    index_phase.stop();
+    options.vout << "Done. Index has " << locations.size()
+                 << " locations and needs " << (locations.used_memory() / (1024 * 1024))
+                 << " MBytes.\n";
 
-    OGREnvelope envelope_all;
+    std::unique_ptr<Timeline> timeline;
+    if (options.sweep) {
+        options.vout << "Building timeline...\n";
+        const auto phase = stats.phase("build_timeline");
+        timeline = std::make_unique<Timeline>(ibuffer.begin<osmium::OSMObject>(),
+                                              first_relation,
+                                              ibuffer.end<osmium::OSMObject>());
+        options.vout << "Done. Timeline has " << timeline->events().size()
+                     << " events and needs " << (timeline->used_memory() / (1024 * 1024))
+                     << " MBytes.\n";
+    }
+
+    std::unique_ptr<CompactHistory> compact_history;
+    if (options.compact) {
+        options.vout << "Building compact history...\n";
+        auto phase = stats.phase("build_compact_history");
+        compact_history = std::make_unique<CompactHistory>(ibuffer.begin<osmium::OSMObject>(),
+                                                           ibuffer.end<osmium::OSMObject>());
+        phase.stop();
+        const auto input_size = ibuffer.committed();
+        options.vout << "Done. Compact history of " << compact_history->num_objects()
+                     << " objects needs " << (compact_history->used_memory() / (1024 * 1024))
+                     << " MBytes (" << (100 * compact_history->used_memory() / std::max(input_size, std::size_t{1}))
+                     << "% of input data).\n";
+
+        // The input data isn't needed any more, everything else is built
+        // from the compact history.
+        input_buffer = osmium::memory::Buffer{};
+        history_file.reset();
+    }
+
+    std::vector<osmium::Timestamp> steps;
     const int seconds_per_day = 24 * 60 * 60;
     const auto step = options.time_step * seconds_per_day;
     for (osmium::Timestamp t = start_time; t <= end_time; t += step) {
-        OGREnvelope env = extract(
-            options,
-            factory,
-            ibuffer.begin<osmium::OSMObject>(),
-            first_relation,
-            ibuffer.end<osmium::OSMObject>(),
-            t
-        );
-        envelope_all.Merge(env);
+        steps.push_back(t);
+    }
+    stats.add("time_steps", steps.size());
+
+    // For the animation the area covered by all node locations ever is
+    // used, so that all frames can be rendered independently.
+    OGREnvelope raster_envelope;
+    std::unique_ptr<GifWriter> gif_writer;
+    std::vector<std::string> frames;
+    if (!options.animation_file.empty()) {
+        const osmium::Box box = locations.bounding_box();
+        if (!box.valid()) {
+            std::cerr << "No node locations in input file.\n";
+            std::exit(return_code::fatal);
+        }
+        const auto bottom_left = osmium::geom::lonlat_to_mercator(osmium::geom::Coordinates{box.bottom_left()});
+        const auto top_right = osmium::geom::lonlat_to_mercator(osmium::geom::Coordinates{box.top_right()});
+        raster_envelope.MinX = bottom_left.x;
+        raster_envelope.MinY = bottom_left.y;
+        raster_envelope.MaxX = top_right.x;
+        raster_envelope.MaxY = top_right.y;
+
+        const Raster raster{raster_envelope.MinX, raster_envelope.MinY, raster_envelope.MaxX, raster_envelope.MaxY, options.width};
+        options.vout << "Animation will be " << raster.width() << 'x' << raster.height() << " pixels.\n";
+        gif_writer = std::make_unique<GifWriter>(raster.width(), raster.height(), options.delay, 255, 255, 255);
+        frames.resize(steps.size());
+    }
+
+    if (options.output_format == "SQLite") {
+        CPLSetConfigOption("OGR_SQLITE_SYNCHRONOUS", "FALSE");
+        CPLSetConfigOption("OGR_SQLITE_CACHE", "512");
+    }
+
+    // In temporal mode all time steps go into a single dataset
+    std::unique_ptr<gdalcpp::Dataset> temporal_dataset;
+    std::unique_ptr<TemporalOutput> temporal;
+    if (options.temporal) {
+        std::vector<std::string> datasource_options;
+        std::string datasource_name{options.output_directory + "/history"};
+        if (options.output_format == "GeoJSON") {
+            datasource_name += ".json";
+        } else if (options.output_format == "SQLite") {
+            datasource_name += ".db";
+            datasource_options.push_back("SPATIALITE=TRUE");
+        }
+        temporal_dataset = std::make_unique<gdalcpp::Dataset>(options.output_format,
+                                                              datasource_name,
+                                                              gdalcpp::SRS{osmium::geom::MercatorProjection{}.proj_string()},
+                                                              datasource_options);
+        if (options.transaction_size > 0 && temporal_dataset->get().TestCapability(ODsCTransactions)) {
+            temporal_dataset->enable_auto_transactions(options.transaction_size);
+        }
+        temporal = std::make_unique<TemporalOutput>(*temporal_dataset);
+    }
+
+    // Each worker takes the next time step not yet worked on. So each
+    // worker sees increasing points in time and can use its own timeline
+    // cursor and area cache. The node location index is read-only and
+    // shared. Everything else needed for a time step (filtered data,
+    // multipolygon manager, output dataset) is created per time step and
+    // not shared between workers.
+    std::atomic<std::size_t> next_step{0};
+    std::mutex vout_mutex;
+    const bool progress = options.threads == 1;
+
+    const auto worker = [&]() {
+        osmium::geom::OGRFactory<osmium::geom::MercatorProjection> factory{osmium::geom::MercatorProjection{}};
+
+        AreaCache area_cache{options.area_cache};
+
+        std::unique_ptr<TimelineCursor> cursor;
+        if (timeline) {
+            cursor = std::make_unique<TimelineCursor>(*timeline);
+        }
+
+        OGREnvelope envelope;
+        for (std::size_t n = next_step++; n < steps.size(); n = next_step++) {
+            const osmium::Timestamp t = steps[n];
+            if (progress) {
+                options.vout << "Working on " << t << "...\n";
+                options.vout << "  Filtering data...\n";
+            }
+
+            auto filter_phase = stats.phase("filter_history");
+            osmium::memory::Buffer fbuffer{initial_buffer_size, osmium::memory::Buffer::auto_grow::yes};
+            osmium::memory::Buffer rbuffer{initial_buffer_size, osmium::memory::Buffer::auto_grow::yes};
+            if (compact_history) {
+                compact_history->snapshot(t, fbuffer, rbuffer);
+            } else if (cursor) {
+                cursor->snapshot(t, fbuffer, rbuffer);
+            } else {
+                filter_history(ibuffer.begin<osmium::OSMObject>(),
+                               first_relation,
+                               ibuffer.end<osmium::OSMObject>(),
+                               t,
+                               fbuffer,
+                               rbuffer);
+            }
+            filter_phase.stop();
+            if (progress) {
+                options.vout << "  Done. Filtered data needs "
+                             << (fbuffer.committed() / (1024 * 1024))
+                             << " MBytes.\n";
+            }
+
+            if (gif_writer) {
+                Raster raster{raster_envelope.MinX, raster_envelope.MinY, raster_envelope.MaxX, raster_envelope.MaxY, options.width};
+                envelope.Merge(extract(options, stats, factory, locations, area_cache, fbuffer, rbuffer, t, &raster, temporal.get(), n, progress));
+                const auto phase = stats.phase("encode_frame");
+                frames[n] = gif_writer->encode_frame(raster.pixels());
+            } else {
+                envelope.Merge(extract(options, stats, factory, locations, area_cache, fbuffer, rbuffer, t, nullptr, temporal.get(), n, progress));
+            }
+
+            if (!progress) {
+                const std::lock_guard<std::mutex> lock{vout_mutex};
+                options.vout << "Done with " << t << " (" << (n + 1) << "/" << steps.size() << ").\n";
+            }
+        }
+
+        return envelope;
+    };
+
+    OGREnvelope envelope_all;
+    if (options.threads == 1) {
+        envelope_all = worker();
+    } else {
+        std::vector<std::future<OGREnvelope>> results;
+        for (unsigned int i = 0; i < options.threads; ++i) {
+            results.push_back(std::async(std::launch::async, worker));
+        }
+        for (auto& result : results) {
+            envelope_all.Merge(result.get());
+        }
+    }
+
+    if (temporal) {
+        options.vout << "Writing features existing at the end...\n";
+        const auto phase = stats.phase("temporal_output");
+        temporal->close();
+        temporal.reset();
+        temporal_dataset.reset();
+    }
+
+    if (gif_writer) {
+        options.vout << "Writing animation...\n";
+        const auto phase = stats.phase("write_animation");
+        gif_writer->write(options.animation_file, frames);
     }
 
     std::ofstream env_out{options.output_directory + "/bbox", std::ofstream::out};
@@ -246,6 +635,15 @@ int main(int argc, char* argv[]) {
                  << envelope_all.MaxY
                  << ")\n";
 
+    if (!options.stats_filename.empty()) {
+        try {
+            stats.write_json(options.stats_filename);
+        } catch (const std::runtime_error& e) {
+            std::cerr << e.what() << "\n";
+            std::exit(return_code::error);
+        }
+    }
+
     options.vout << "Done.\n";
 
     return return_code::okay;
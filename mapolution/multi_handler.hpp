@@ -0,0 +1,137 @@
+#ifndef MULTI_HANDLER_HPP
+#define MULTI_HANDLER_HPP
+
+// The code in this file is released into the Public Domain.
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <osmium/osm/entity_bits.hpp>
+#include <osmium/tags/matcher.hpp>
+
+#include "geom_handler.hpp"
+
+#include "handlers/buildings.hpp"
+#include "handlers/restaurants.hpp"
+#include "handlers/roads.hpp"
+
+using handler_creator_type = std::function<std::unique_ptr<GeomHandler>(GeomHandler::factory_type&, gdalcpp::Dataset&, const std::string&)>;
+
+template <typename THandler>
+std::unique_ptr<GeomHandler> create_handler(GeomHandler::factory_type& factory, gdalcpp::Dataset& dataset, const std::string& date) {
+    return std::make_unique<THandler>(factory, dataset, date);
+}
+
+/**
+ * What we know about a handler: How to create it and which objects it is
+ * interested in (used to filter the input data).
+ */
+struct handler_info {
+    handler_creator_type create;
+
+    // Types of objects the handler needs. Areas can be created from ways
+    // and relations.
+    osmium::osm_entity_bits::type entities;
+
+    // Tags those objects must have
+    osmium::TagMatcher matcher;
+};
+
+/**
+ * All handlers which can be selected on the command line by name. Add
+ * your own handlers here.
+ */
+inline const std::map<std::string, handler_info>& handler_registry() {
+    static const std::map<std::string, handler_info> registry{
+        {"buildings",   {create_handler<BuildingsHandler>,
+                         osmium::osm_entity_bits::way | osmium::osm_entity_bits::relation,
+                         osmium::TagMatcher{"building"}}},
+        {"restaurants", {create_handler<RestaurantsHandler>,
+                         osmium::osm_entity_bits::node,
+                         osmium::TagMatcher{"amenity", "restaurant"}}},
+        {"roads",       {create_handler<RoadsHandler>,
+                         osmium::osm_entity_bits::way,
+                         osmium::TagMatcher{"highway"}}}
+    };
+    return registry;
+}
+
+/**
+ * Handler forwarding all nodes, ways, and areas to several GeomHandlers,
+ * so they all can work in a single pass over the data. All handlers
+ * write into different layers of the same dataset.
+ */
+class MultiHandler : public osmium::handler::Handler {
+
+    std::vector<std::unique_ptr<GeomHandler>> m_handlers;
+
+public:
+
+    /**
+     * Create the handlers with the given names. The names must be in the
+     * handler_registry().
+     */
+    MultiHandler(const std::vector<std::string>& names, GeomHandler::factory_type& factory, gdalcpp::Dataset& dataset, const std::string& date) {
+        for (const auto& name : names) {
+            m_handlers.push_back(handler_registry().at(name).create(factory, dataset, date));
+        }
+    }
+
+    void set_raster(Raster* raster) noexcept {
+        for (auto& handler : m_handlers) {
+            handler->set_raster(raster);
+        }
+    }
+
+    void set_writer(FeatureWriter* writer) noexcept {
+        for (auto& handler : m_handlers) {
+            handler->set_writer(writer);
+        }
+    }
+
+    void set_direct_geometry(bool direct) noexcept {
+        for (auto& handler : m_handlers) {
+            handler->set_direct_geometry(direct);
+        }
+    }
+
+    std::size_t count() const noexcept {
+        std::size_t count = 0;
+        for (const auto& handler : m_handlers) {
+            count += handler->count();
+        }
+        return count;
+    }
+
+    OGREnvelope envelope() const {
+        OGREnvelope envelope;
+        for (const auto& handler : m_handlers) {
+            envelope.Merge(handler->envelope());
+        }
+        return envelope;
+    }
+
+    void node(const osmium::Node& node) {
+        for (auto& handler : m_handlers) {
+            handler->node(node);
+        }
+    }
+
+    void way(const osmium::Way& way) {
+        for (auto& handler : m_handlers) {
+            handler->way(way);
+        }
+    }
+
+    void area(const osmium::Area& area) {
+        for (auto& handler : m_handlers) {
+            handler->area(area);
+        }
+    }
+
+}; // class MultiHandler
+
+#endif // MULTI_HANDLER_HPP
@@ -0,0 +1,451 @@
+#ifndef PREFILTER_HPP
+#define PREFILTER_HPP
+
+// The code in this file is released into the Public Domain.
+
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <gdal_priv.h>
+#include <ogrsf_frmts.h>
+
+#include <osmium/index/id_set.hpp>
+#include <osmium/io/any_input.hpp>
+#include <osmium/memory/buffer.hpp>
+#include <osmium/osm/box.hpp>
+#include <osmium/osm/entity_bits.hpp>
+#include <osmium/osm/location.hpp>
+#include <osmium/osm/node.hpp>
+#include <osmium/osm/relation.hpp>
+#include <osmium/osm/types.hpp>
+#include <osmium/osm/way.hpp>
+#include <osmium/tags/taglist.hpp>
+#include <osmium/tags/tags_filter.hpp>
+
+/**
+ * A (multi)polygon read from any file OGR can read (for instance a
+ * GeoJSON file) used to check whether locations are inside it. All
+ * polygons in the first layer are used, coordinates must be WGS84.
+ *
+ * The edges are sorted into horizontal bands, so that checking a location
+ * only needs to look at the edges in one band.
+ */
+class PolygonFilter {
+
+    static constexpr const int num_bands = 1024;
+
+    struct edge {
+        double x1;
+        double y1;
+        double x2;
+        double y2;
+    };
+
+    osmium::Box m_box;
+    double m_band_height = 1.0;
+    std::vector<std::vector<edge>> m_bands;
+
+    void add_ring(const OGRLinearRing& ring, std::vector<edge>& edges) {
+        for (int i = 1; i < ring.getNumPoints(); ++i) {
+            edges.push_back(edge{ring.getX(i - 1), ring.getY(i - 1), ring.getX(i), ring.getY(i)});
+            m_box.extend(osmium::Location{ring.getX(i), ring.getY(i)});
+        }
+    }
+
+    void add_polygon(const OGRPolygon& polygon, std::vector<edge>& edges) {
+        add_ring(*polygon.getExteriorRing(), edges);
+        for (int r = 0; r < polygon.getNumInteriorRings(); ++r) {
+            add_ring(*polygon.getInteriorRing(r), edges);
+        }
+    }
+
+    int band(double y) const noexcept {
+        const int b = static_cast<int>((y - m_box.bottom_left().lat()) / m_band_height);
+        return std::min(std::max(b, 0), num_bands - 1);
+    }
+
+public:
+
+    explicit PolygonFilter(const std::string& filename) {
+        GDALAllRegister();
+
+        std::unique_ptr<GDALDataset> dataset{static_cast<GDALDataset*>(GDALOpenEx(filename.c_str(), GDAL_OF_VECTOR | GDAL_OF_READONLY, nullptr, nullptr, nullptr))};
+        if (!dataset || dataset->GetLayerCount() == 0) {
+            throw std::runtime_error{"Can not read polygon from '" + filename + "'"};
+        }
+
+        std::vector<edge> edges;
+        OGRLayer& layer = *dataset->GetLayer(0);
+        layer.ResetReading();
+        while (OGRFeature* feature = layer.GetNextFeature()) {
+            const OGRGeometry* geometry = feature->GetGeometryRef();
+            if (geometry) {
+                switch (wkbFlatten(geometry->getGeometryType())) {
+                    case wkbPolygon:
+                        add_polygon(*static_cast<const OGRPolygon*>(geometry), edges);
+                        break;
+                    case wkbMultiPolygon: {
+                        const auto& multipolygon = *static_cast<const OGRMultiPolygon*>(geometry);
+                        for (int p = 0; p < multipolygon.getNumGeometries(); ++p) {
+                            add_polygon(*static_cast<const OGRPolygon*>(multipolygon.getGeometryRef(p)), edges);
+                        }
+                        break;
+                    }
+                    default:
+                        break;
+                }
+            }
+            OGRFeature::DestroyFeature(feature);
+        }
+
+        if (edges.empty()) {
+            throw std::runtime_error{"No polygons found in '" + filename + "'"};
+        }
+
+        m_band_height = std::max((m_box.top_right().lat() - m_box.bottom_left().lat()) / num_bands, 1e-9);
+        m_bands.resize(num_bands);
+        for (const auto& e : edges) {
+            const int first = band(std::min(e.y1, e.y2));
+            const int last = band(std::max(e.y1, e.y2));
+            for (int b = first; b <= last; ++b) {
+                m_bands[b].push_back(e);
+            }
+        }
+    }
+
+    const osmium::Box& box() const noexcept {
+        return m_box;
+    }
+
+    /**
+     * Is the location inside the polygon? (Even-odd rule.)
+     */
+    bool contains(const osmium::Location& location) const {
+        if (!location.valid() || !m_box.contains(location)) {
+            return false;
+        }
+
+        const double x = location.lon();
+        const double y = location.lat();
+        bool inside = false;
+        for (const auto& e : m_bands[band(y)]) {
+            if ((e.y1 > y) != (e.y2 > y) &&
+                x < e.x1 + (y - e.y1) * (e.x2 - e.x1) / (e.y2 - e.y1)) {
+                inside = !inside;
+            }
+        }
+        return inside;
+    }
+
+}; // class PolygonFilter
+
+/**
+ * Filters the history data while reading it, keeping only objects inside
+ * a bounding box or polygon and/or objects with the tags the handlers
+ * need. Always all versions of an object are kept or none.
+ *
+ * This needs several passes over the input file:
+ *
+ * 1. Nodes: Remember which nodes ever were inside the area and which
+ *    ever had the tags we are looking for.
+ * 2. Relations: Remember the member ways of relations which ever had the
+ *    tags we are looking for (only when filtering by tags).
+ * 3. Ways: Keep ways which ever had the tags we are looking for (or are
+ *    members of the relations from pass 2) and of which any node ever was
+ *    inside the area. Remember all nodes of all versions of those ways.
+ * 4. Relations: Keep all relations referencing any of those nodes or ways
+ *    which either had the tags or are multipolygon relations (which might
+ *    have the tags on their ways). Also keep all member ways of kept
+ *    multipolygon relations, whatever their tags and location, so the
+ *    areas can be assembled, and (in another pass) their nodes.
+ * 5. Read everything and keep those nodes, ways, and relations.
+ */
+class Prefilter {
+
+    using id_set_type = osmium::index::IdSetDense<osmium::unsigned_object_id_type>;
+
+    using callback_type = std::function<void(const osmium::memory::Buffer&)>;
+
+    static constexpr const std::size_t initial_buffer_size = 10UL * 1024UL * 1024UL;
+
+    osmium::Box m_box;
+    std::unique_ptr<PolygonFilter> m_polygon;
+
+    bool m_filter_tags = false;
+    osmium::TagsFilter m_node_filter{false};
+    osmium::TagsFilter m_way_filter{false};
+    osmium::TagsFilter m_relation_filter{false};
+
+    // nodes ever inside the area
+    id_set_type m_inside_nodes;
+
+    // nodes ever inside the area and with the tags
+    id_set_type m_tagged_nodes;
+
+    // members of relations with the tags
+    id_set_type m_member_ways;
+
+    // relations ever having the tags
+    id_set_type m_tagged_relations;
+
+    // ways we keep and their nodes
+    id_set_type m_ways;
+    id_set_type m_way_nodes;
+
+    // member ways of multipolygon relations we keep which were not kept
+    // because of their own tags and location
+    id_set_type m_extra_ways;
+
+    // relations we keep
+    id_set_type m_relations;
+
+    // all versions of the current relation
+    osmium::memory::Buffer m_relation_versions{1024UL * 1024UL, osmium::memory::Buffer::auto_grow::yes};
+
+    bool spatial() const noexcept {
+        return m_box.valid() || m_polygon;
+    }
+
+    bool inside(const osmium::Location& location) const {
+        if (m_polygon) {
+            return m_polygon->contains(location);
+        }
+        return !m_box.valid() || (location.valid() && m_box.contains(location));
+    }
+
+    // The multipolygon manager assembles areas from these relations.
+    static bool is_multipolygon(const osmium::Relation& relation) noexcept {
+        const char* type = relation.tags()["type"];
+        return type && (!std::strcmp(type, "multipolygon") || !std::strcmp(type, "boundary"));
+    }
+
+    bool node_wanted(osmium::unsigned_object_id_type id) const {
+        return m_way_nodes.get(id) || (m_filter_tags ? m_tagged_nodes.get(id) : (!spatial() || m_inside_nodes.get(id)));
+    }
+
+    template <typename TFunc>
+    static void read(const osmium::io::File& file, osmium::osm_entity_bits::type entities, TFunc&& func) {
+        osmium::io::Reader reader{file, entities};
+        while (osmium::memory::Buffer buffer = reader.read()) {
+            func(buffer);
+        }
+        reader.close();
+    }
+
+    void pass_nodes(const osmium::io::File& file) {
+        read(file, osmium::osm_entity_bits::node, [this](const osmium::memory::Buffer& buffer) {
+            for (const auto& node : buffer.select<osmium::Node>()) {
+                if (node.visible() && inside(node.location())) {
+                    m_inside_nodes.set(node.positive_id());
+                    if (m_filter_tags && osmium::tags::match_any_of(node.tags(), std::cref(m_node_filter))) {
+                        m_tagged_nodes.set(node.positive_id());
+                    }
+                }
+            }
+        });
+    }
+
+    void pass_relations(const osmium::io::File& file) {
+        read(file, osmium::osm_entity_bits::relation, [this](const osmium::memory::Buffer& buffer) {
+            for (const auto& relation : buffer.select<osmium::Relation>()) {
+                if (osmium::tags::match_any_of(relation.tags(), std::cref(m_relation_filter))) {
+                    m_tagged_relations.set(relation.positive_id());
+                    for (const auto& member : relation.members()) {
+                        if (member.type() == osmium::item_type::way) {
+                            m_member_ways.set(member.positive_ref());
+                        }
+                    }
+                }
+            }
+        });
+    }
+
+    void pass_ways(const osmium::io::File& file) {
+        // Ways we are interested in because of their tags
+        id_set_type tagged_ways;
+
+        // Ways with any node inside the area
+        id_set_type inside_ways;
+
+        read(file, osmium::osm_entity_bits::way, [&](const osmium::memory::Buffer& buffer) {
+            for (const auto& way : buffer.select<osmium::Way>()) {
+                if (!m_filter_tags ||
+                    m_member_ways.get(way.positive_id()) ||
+                    osmium::tags::match_any_of(way.tags(), std::cref(m_way_filter))) {
+                    tagged_ways.set(way.positive_id());
+                }
+                if (!spatial() || std::any_of(way.nodes().cbegin(), way.nodes().cend(), [this](const osmium::NodeRef& node_ref) {
+                        return m_inside_nodes.get(node_ref.positive_ref());
+                    })) {
+                    inside_ways.set(way.positive_id());
+                }
+            }
+        });
+
+        for (const auto id : tagged_ways) {
+            if (inside_ways.get(id)) {
+                m_ways.set(id);
+            }
+        }
+
+        add_way_nodes(file, m_ways);
+    }
+
+    void add_way_nodes(const osmium::io::File& file, const id_set_type& ways) {
+        read(file, osmium::osm_entity_bits::way, [&](const osmium::memory::Buffer& buffer) {
+            for (const auto& way : buffer.select<osmium::Way>()) {
+                if (ways.get(way.positive_id())) {
+                    for (const auto& node_ref : way.nodes()) {
+                        m_way_nodes.set(node_ref.positive_ref());
+                    }
+                }
+            }
+        });
+    }
+
+    bool relation_wanted(const osmium::Relation& relation) const {
+        if (m_filter_tags && !m_tagged_relations.get(relation.positive_id()) && !is_multipolygon(relation)) {
+            return false;
+        }
+        return std::any_of(relation.members().cbegin(), relation.members().cend(), [this](const osmium::RelationMember& member) {
+            switch (member.type()) {
+                case osmium::item_type::node:
+                    return node_wanted(member.positive_ref());
+                case osmium::item_type::way:
+                    return m_ways.get(member.positive_ref());
+                default:
+                    return false;
+            }
+        });
+    }
+
+    // Called for all versions of a relation in m_relation_versions
+    void flush_relation() {
+        const auto begin = m_relation_versions.cbegin<osmium::Relation>();
+        const auto end = m_relation_versions.cend<osmium::Relation>();
+        if (begin != end && std::any_of(begin, end, [this](const osmium::Relation& relation) {
+                return relation_wanted(relation);
+            })) {
+            m_relations.set(begin->positive_id());
+            for (auto it = begin; it != end; ++it) {
+                if (!is_multipolygon(*it)) {
+                    continue;
+                }
+                for (const auto& member : it->members()) {
+                    if (member.type() == osmium::item_type::way && !m_ways.get(member.positive_ref())) {
+                        m_extra_ways.set(member.positive_ref());
+                    }
+                }
+            }
+        }
+        m_relation_versions.clear();
+    }
+
+    void pass_kept_relations(const osmium::io::File& file) {
+        osmium::object_id_type last_relation_id = 0;
+        read(file, osmium::osm_entity_bits::relation, [&](const osmium::memory::Buffer& buffer) {
+            for (const auto& relation : buffer.select<osmium::Relation>()) {
+                if (relation.id() != last_relation_id) {
+                    flush_relation();
+                    last_relation_id = relation.id();
+                }
+                m_relation_versions.add_item(relation);
+                m_relation_versions.commit();
+            }
+        });
+        flush_relation();
+
+        if (!m_extra_ways.empty()) {
+            for (const auto id : m_extra_ways) {
+                m_ways.set(id);
+            }
+            add_way_nodes(file, m_extra_ways);
+        }
+    }
+
+public:
+
+    /**
+     * Filter by bounding box (if valid), polygon in file (if not empty),
+     * and tags (if filter_tags is set) with filters for the tags built
+     * from the handler infos.
+     */
+    template <typename THandlerInfos>
+    Prefilter(const osmium::Box& box, const std::string& polygon_file, bool filter_tags, const THandlerInfos& handler_infos) :
+        m_box(box),
+        m_filter_tags(filter_tags) {
+        if (!polygon_file.empty()) {
+            m_polygon = std::make_unique<PolygonFilter>(polygon_file);
+        }
+        for (const auto* info : handler_infos) {
+            if (info->entities & osmium::osm_entity_bits::node) {
+                m_node_filter.add_rule(true, info->matcher);
+            }
+            if (info->entities & osmium::osm_entity_bits::way) {
+                m_way_filter.add_rule(true, info->matcher);
+            }
+            if (info->entities & osmium::osm_entity_bits::relation) {
+                m_relation_filter.add_rule(true, info->matcher);
+            }
+        }
+    }
+
+    /**
+     * Read the file in several passes and call the callback with buffers
+     * containing the filtered data.
+     */
+    void apply(const osmium::io::File& file, const callback_type& callback) {
+        if (spatial() || m_filter_tags) {
+            pass_nodes(file);
+        }
+        if (m_filter_tags) {
+            pass_relations(file);
+        }
+        pass_ways(file);
+        pass_kept_relations(file);
+
+        read(file, osmium::osm_entity_bits::object, [&](const osmium::memory::Buffer& buffer) {
+            osmium::memory::Buffer out{initial_buffer_size, osmium::memory::Buffer::auto_grow::yes};
+            for (const auto& object : buffer.select<osmium::OSMObject>()) {
+                switch (object.type()) {
+                    case osmium::item_type::node:
+                        if (node_wanted(object.positive_id())) {
+                            out.add_item(object);
+                            out.commit();
+                        }
+                        break;
+                    case osmium::item_type::way:
+                        if (m_ways.get(object.positive_id())) {
+                            out.add_item(object);
+                            out.commit();
+                        }
+                        break;
+                    case osmium::item_type::relation:
+                        if (m_relations.get(object.positive_id())) {
+                            out.add_item(object);
+                            out.commit();
+                        }
+                        break;
+                    default:
+                        break;
+                }
+            }
+            callback(out);
+        });
+    }
+
+    std::size_t used_memory() const noexcept {
+        return m_inside_nodes.used_memory() + m_tagged_nodes.used_memory() +
+               m_member_ways.used_memory() + m_tagged_relations.used_memory() +
+               m_ways.used_memory() + m_way_nodes.used_memory() +
+               m_extra_ways.used_memory() + m_relations.used_memory();
+    }
+
+}; // class Prefilter
+
+#endif // PREFILTER_HPP
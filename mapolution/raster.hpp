@@ -0,0 +1,152 @@
+#ifndef RASTER_HPP
+#define RASTER_HPP
+
+// The code in this file is released into the Public Domain.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+
+/**
+ * A one-bit image (stored as one byte per pixel) covering a rectangle
+ * given in projected coordinates. Geometries in projected coordinates
+ * are drawn into it: Points are set, lines drawn with Bresenham's
+ * algorithm, and polygons filled with a scanline algorithm using the
+ * even-odd rule, setting all pixels whose center is inside the polygon.
+ * This gives the same results as gdal_rasterize with default options.
+ */
+class Raster {
+
+public:
+
+    struct point {
+        double x;
+        double y;
+    };
+
+private:
+
+    double m_min_x;
+    double m_max_y;
+    double m_scale;
+    int m_width;
+    int m_height;
+    std::vector<uint8_t> m_pixels;
+
+public:
+
+    Raster(double min_x, double min_y, double max_x, double max_y, int width) :
+        m_min_x(min_x),
+        m_max_y(max_y),
+        m_scale(max_x > min_x ? width / (max_x - min_x) : 1.0),
+        m_width(width),
+        m_height(std::max(1, static_cast<int>((max_y - min_y) * m_scale))),
+        m_pixels(static_cast<std::size_t>(m_width) * static_cast<std::size_t>(m_height), 0) {
+    }
+
+    int width() const noexcept {
+        return m_width;
+    }
+
+    int height() const noexcept {
+        return m_height;
+    }
+
+    const std::vector<uint8_t>& pixels() const noexcept {
+        return m_pixels;
+    }
+
+    /// Convert projected coordinates into pixel coordinates.
+    point to_pixel(double x, double y) const noexcept {
+        return point{(x - m_min_x) * m_scale, (m_max_y - y) * m_scale};
+    }
+
+    void set_pixel(int x, int y) noexcept {
+        if (x >= 0 && x < m_width && y >= 0 && y < m_height) {
+            m_pixels[static_cast<std::size_t>(y) * m_width + x] = 1;
+        }
+    }
+
+    void draw_point(const point& p) noexcept {
+        set_pixel(static_cast<int>(std::floor(p.x)), static_cast<int>(std::floor(p.y)));
+    }
+
+    void draw_line(const point& a, const point& b) noexcept {
+        int x0 = static_cast<int>(std::floor(a.x));
+        int y0 = static_cast<int>(std::floor(a.y));
+        const int x1 = static_cast<int>(std::floor(b.x));
+        const int y1 = static_cast<int>(std::floor(b.y));
+
+        const int dx = std::abs(x1 - x0);
+        const int dy = -std::abs(y1 - y0);
+        const int sx = x0 < x1 ? 1 : -1;
+        const int sy = y0 < y1 ? 1 : -1;
+        int err = dx + dy;
+
+        while (true) {
+            set_pixel(x0, y0);
+            if (x0 == x1 && y0 == y1) {
+                return;
+            }
+            const int e2 = 2 * err;
+            if (e2 >= dy) {
+                err += dy;
+                x0 += sx;
+            }
+            if (e2 <= dx) {
+                err += dx;
+                y0 += sy;
+            }
+        }
+    }
+
+    /**
+     * Fill the polygon made up of the given rings (outer and inner rings
+     * in any order and orientation). Rings must be closed, ie. the first
+     * and last points must be the same.
+     */
+    void fill_polygon(const std::vector<std::vector<point>>& rings) {
+        double min_y = m_height;
+        double max_y = 0;
+        for (const auto& ring : rings) {
+            for (const auto& p : ring) {
+                min_y = std::min(min_y, p.y);
+                max_y = std::max(max_y, p.y);
+            }
+        }
+
+        const int first_row = std::max(0, static_cast<int>(std::floor(min_y)));
+        const int last_row = std::min(m_height - 1, static_cast<int>(std::ceil(max_y)));
+
+        std::vector<double> crossings;
+        for (int row = first_row; row <= last_row; ++row) {
+            const double cy = row + 0.5;
+
+            crossings.clear();
+            for (const auto& ring : rings) {
+                for (std::size_t i = 1; i < ring.size(); ++i) {
+                    const point& p = ring[i - 1];
+                    const point& q = ring[i];
+                    if ((p.y <= cy) != (q.y <= cy)) {
+                        crossings.push_back(p.x + (cy - p.y) * (q.x - p.x) / (q.y - p.y));
+                    }
+                }
+            }
+            std::sort(crossings.begin(), crossings.end());
+
+            for (std::size_t i = 0; i + 1 < crossings.size(); i += 2) {
+                const int begin = std::max(0, static_cast<int>(std::ceil(crossings[i] - 0.5)));
+                const int end = std::min(m_width - 1, static_cast<int>(std::floor(crossings[i + 1] - 0.5)));
+                if (begin <= end) {
+                    auto it = m_pixels.begin() + static_cast<std::ptrdiff_t>(row) * m_width;
+                    std::fill(it + begin, it + end + 1, 1);
+                }
+            }
+        }
+    }
+
+}; // class Raster
+
+#endif // RASTER_HPP
@@ -0,0 +1,263 @@
+#ifndef TEMPORAL_OUTPUT_HPP
+#define TEMPORAL_OUTPUT_HPP
+
+// The code in this file is released into the Public Domain.
+
+#include <cstring>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "gdalcpp.hpp"
+
+/**
+ * Writes all features of all time steps into one layer per handler. Each
+ * distinct feature (same geometry and same attributes) is only written
+ * once with the dates from which and until which it existed in the
+ * fields "valid_from" and "valid_to". Features still existing at the
+ * last time step have no "valid_to" date.
+ *
+ * For each time step the handlers write into a dataset in memory. A
+ * snapshot of the features in there is taken with take_snapshot() and
+ * handed over with add(). Snapshots can be added from several threads in
+ * any order, they are always processed in the order of the time steps.
+ * Only features which changed between time steps are written out.
+ */
+class TemporalOutput {
+
+    struct feature_deleter {
+        void operator()(OGRFeature* feature) const {
+            OGRFeature::DestroyFeature(feature);
+        }
+    };
+
+    using feature_ptr = std::unique_ptr<OGRFeature, feature_deleter>;
+
+    // Features are found by a hash over their geometry and attributes
+    // (compared in full with same_feature())
+    using feature_map = std::unordered_multimap<std::size_t, feature_ptr>;
+
+public:
+
+    struct layer_snapshot {
+        OGRwkbGeometryType type;
+        std::vector<std::unique_ptr<OGRFieldDefn>> fields;
+        feature_map features;
+    };
+
+    // Layers by name (without the date)
+    using snapshot = std::map<std::string, layer_snapshot>;
+
+private:
+
+    struct open_feature {
+        std::string valid_from;
+        feature_ptr feature;
+    };
+
+    struct layer {
+        std::unique_ptr<gdalcpp::Layer> layer;
+        int num_fields;
+        std::unordered_multimap<std::size_t, open_feature> open;
+    };
+
+    gdalcpp::Dataset& m_dataset;
+    std::map<std::string, layer> m_layers;
+
+    std::mutex m_mutex;
+    std::map<std::size_t, std::pair<std::string, snapshot>> m_pending;
+    std::size_t m_next_step = 0;
+
+    static std::size_t feature_hash(const OGRFeature& feature) {
+        std::string key;
+
+        const OGRGeometry* geometry = feature.GetGeometryRef();
+        if (geometry) {
+            key.resize(static_cast<std::size_t>(geometry->WkbSize()));
+            geometry->exportToWkb(wkbNDR, reinterpret_cast<unsigned char*>(&key[0]));
+        }
+
+        for (int i = 0; i < feature.GetFieldCount(); ++i) {
+            key += '\0';
+            key += feature.GetFieldAsString(i);
+        }
+
+        return std::hash<std::string>{}(key);
+    }
+
+    // Features with the same hash might still be different.
+    static bool same_feature(const OGRFeature& a, const OGRFeature& b) {
+        if (a.GetFieldCount() != b.GetFieldCount()) {
+            return false;
+        }
+        for (int i = 0; i < a.GetFieldCount(); ++i) {
+            if (std::strcmp(a.GetFieldAsString(i), b.GetFieldAsString(i)) != 0) {
+                return false;
+            }
+        }
+        const OGRGeometry* ga = a.GetGeometryRef();
+        const OGRGeometry* gb = b.GetGeometryRef();
+        if (!ga || !gb) {
+            return !ga && !gb;
+        }
+        // Exact comparison, older GDAL versions take a non-const pointer
+        return ga->Equals(const_cast<OGRGeometry*>(gb));
+    }
+
+    static feature_map::iterator find_feature(feature_map& features, std::size_t hash, const OGRFeature& feature) {
+        const auto range = features.equal_range(hash);
+        for (auto it = range.first; it != range.second; ++it) {
+            if (same_feature(*it->second, feature)) {
+                return it;
+            }
+        }
+        return features.end();
+    }
+
+    layer& get_layer(const std::string& name, const layer_snapshot& snapshot_layer) {
+        const auto it = m_layers.find(name);
+        if (it != m_layers.end()) {
+            return it->second;
+        }
+
+        auto& l = m_layers[name];
+        l.layer = std::make_unique<gdalcpp::Layer>(m_dataset, name, snapshot_layer.type);
+        for (const auto& field : snapshot_layer.fields) {
+            l.layer->add_field(field->GetNameRef(), field->GetType(), field->GetWidth(), field->GetPrecision());
+        }
+        l.layer->add_field("valid_from", OFTString, 10);
+        l.layer->add_field("valid_to", OFTString, 10);
+        l.num_fields = static_cast<int>(snapshot_layer.fields.size());
+        return l;
+    }
+
+    static void write(layer& l, const open_feature& f, const std::string& valid_to) {
+        const OGRFeature& source = *f.feature;
+        gdalcpp::Feature feature{*l.layer, std::unique_ptr<OGRGeometry>{source.GetGeometryRef()->clone()}};
+        for (int i = 0; i < l.num_fields; ++i) {
+            switch (source.GetFieldDefnRef(i)->GetType()) {
+                case OFTInteger:
+                    feature.set_field(i, source.GetFieldAsInteger(i));
+                    break;
+                case OFTReal:
+                    feature.set_field(i, source.GetFieldAsDouble(i));
+                    break;
+                default:
+                    feature.set_field(i, source.GetFieldAsString(i));
+                    break;
+            }
+        }
+        feature.set_field(l.num_fields, f.valid_from.c_str());
+        if (!valid_to.empty()) {
+            feature.set_field(l.num_fields + 1, valid_to.c_str());
+        }
+        feature.add_to_layer();
+    }
+
+    // Compare the features of this time step with the ones still open from
+    // the last: Write out those which are gone, remember new ones.
+    void apply(const std::string& date, snapshot& snap) {
+        for (auto& s : snap) {
+            get_layer(s.first, s.second);
+        }
+
+        for (auto& l : m_layers) {
+            feature_map empty;
+            const auto s = snap.find(l.first);
+            feature_map& current = s == snap.end() ? empty : s->second.features;
+
+            auto& open = l.second.open;
+            for (auto it = open.begin(); it != open.end();) {
+                const auto c = find_feature(current, it->first, *it->second.feature);
+                if (c != current.end()) {
+                    current.erase(c); // unchanged
+                    ++it;
+                } else {
+                    write(l.second, it->second, date);
+                    it = open.erase(it);
+                }
+            }
+
+            for (auto& c : current) {
+                open.emplace(c.first, open_feature{date, std::move(c.second)});
+            }
+        }
+    }
+
+public:
+
+    explicit TemporalOutput(gdalcpp::Dataset& dataset) :
+        m_dataset(dataset) {
+    }
+
+    /**
+     * Take a snapshot of all features in all layers of the dataset. The
+     * layers must have names ending in "_" + date.
+     */
+    static snapshot take_snapshot(gdalcpp::Dataset& dataset, const std::string& date) {
+        snapshot snap;
+
+        for (int n = 0; n < dataset.get().GetLayerCount(); ++n) {
+            OGRLayer& ogr_layer = *dataset.get().GetLayer(n);
+            std::string name{ogr_layer.GetName()};
+            const std::string suffix{"_" + date};
+            if (name.size() > suffix.size() && name.compare(name.size() - suffix.size(), suffix.size(), suffix) == 0) {
+                name.resize(name.size() - suffix.size());
+            }
+
+            auto& s = snap[name];
+            OGRFeatureDefn& defn = *ogr_layer.GetLayerDefn();
+            s.type = defn.GetGeomType();
+            for (int i = 0; i < defn.GetFieldCount(); ++i) {
+                s.fields.push_back(std::make_unique<OGRFieldDefn>(defn.GetFieldDefn(i)));
+            }
+
+            ogr_layer.ResetReading();
+            while (OGRFeature* feature = ogr_layer.GetNextFeature()) {
+                feature_ptr f{feature};
+                if (f->GetGeometryRef()) {
+                    const std::size_t hash = feature_hash(*f);
+                    s.features.emplace(hash, std::move(f));
+                }
+            }
+        }
+
+        return snap;
+    }
+
+    /**
+     * Add snapshot for the given time step (counting from 0). Thread safe.
+     */
+    void add(std::size_t step, const std::string& date, snapshot&& snap) {
+        const std::lock_guard<std::mutex> lock{m_mutex};
+
+        m_pending.emplace(step, std::make_pair(date, std::move(snap)));
+        while (!m_pending.empty() && m_pending.begin()->first == m_next_step) {
+            apply(m_pending.begin()->second.first, m_pending.begin()->second.second);
+            m_pending.erase(m_pending.begin());
+            ++m_next_step;
+        }
+    }
+
+    /**
+     * Write all features still existing at the last time step.
+     */
+    void close() {
+        const std::lock_guard<std::mutex> lock{m_mutex};
+
+        for (auto& l : m_layers) {
+            for (const auto& f : l.second.open) {
+                write(l.second, f.second, "");
+            }
+            l.second.open.clear();
+        }
+    }
+
+}; // class TemporalOutput
+
+#endif // TEMPORAL_OUTPUT_HPP
@@ -0,0 +1,15 @@
+#!/bin/sh
+#
+#  dump.sh DIR
+#
+#  Print the features from all GeoJSON files in DIR as CSV with WKT
+#  geometries. The lines for each file are sorted, so the output of runs
+#  writing the features in a different order can be compared.
+#
+
+set -e
+
+for file in "$1"/*.json; do
+    echo "${file##*/}"
+    ogr2ogr --config OGR_WKT_PRECISION 10 -f CSV /vsistdout/ "$file" -lco GEOMETRY=AS_WKT | LC_ALL=C sort
+done
@@ -0,0 +1,166 @@
+#ifndef TIMELINE_HPP
+#define TIMELINE_HPP
+
+// The code in this file is released into the Public Domain.
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <tuple>
+#include <vector>
+
+#include <osmium/diff_iterator.hpp>
+#include <osmium/memory/buffer.hpp>
+#include <osmium/osm/object.hpp>
+#include <osmium/osm/timestamp.hpp>
+
+/**
+ * All changes in the history data sorted by time. Each object (all
+ * versions of a node, way, or relation) gets a slot, the slots are
+ * numbered in the order the objects appear in the input buffer. For each
+ * version there is an event when it becomes visible and one when it
+ * stops being visible (if it does). This class is immutable after
+ * construction. Use TimelineCursor to get the data visible at some point
+ * in time.
+ */
+class Timeline {
+
+public:
+
+    using iterator = osmium::memory::Buffer::t_iterator<osmium::OSMObject>;
+
+    struct event {
+        osmium::Timestamp time;
+        uint32_t slot;
+        bool add;
+        const osmium::OSMObject* object;
+
+        friend bool operator<(const event& lhs, const event& rhs) noexcept {
+            // At the same time, first remove old versions, then add new ones.
+            return std::make_tuple(lhs.time, lhs.add, lhs.slot) < std::make_tuple(rhs.time, rhs.add, rhs.slot);
+        }
+    };
+
+private:
+
+    std::vector<event> m_events;
+    uint32_t m_num_slots = 0;
+    uint32_t m_first_relation_slot = 0;
+
+    void add_range(iterator begin, iterator end) {
+        using diff_iterator = osmium::DiffIterator<iterator>;
+
+        const diff_iterator dbegin{begin, end};
+        const diff_iterator dend{end, end};
+
+        std::for_each(dbegin, dend, [this](const osmium::DiffObject& d) {
+            if (d.first()) {
+                ++m_num_slots;
+            }
+
+            // Same semantics as in DiffObject::is_visible_at(): A version
+            // is visible from its timestamp until the timestamp of the next
+            // version.
+            if (!d.curr().visible() || d.start_time() >= d.end_time()) {
+                return;
+            }
+
+            const uint32_t slot = m_num_slots - 1;
+            m_events.push_back(event{d.start_time(), slot, true, &d.curr()});
+            if (!d.last()) {
+                m_events.push_back(event{d.end_time(), slot, false, &d.curr()});
+            }
+        });
+    }
+
+public:
+
+    Timeline(iterator begin, iterator relations, iterator end) {
+        add_range(begin, relations);
+        m_first_relation_slot = m_num_slots;
+        add_range(relations, end);
+
+        std::sort(m_events.begin(), m_events.end());
+    }
+
+    const std::vector<event>& events() const noexcept {
+        return m_events;
+    }
+
+    uint32_t num_slots() const noexcept {
+        return m_num_slots;
+    }
+
+    uint32_t first_relation_slot() const noexcept {
+        return m_first_relation_slot;
+    }
+
+    std::size_t used_memory() const noexcept {
+        return m_events.capacity() * sizeof(event);
+    }
+
+}; // class Timeline
+
+/**
+ * Keeps track of which version of each object is visible while moving
+ * forward in time. Moving from one point in time to the next only needs
+ * to apply the events in between, so sweeping over the whole timeline
+ * costs time proportional to the size of the history.
+ */
+class TimelineCursor {
+
+    const Timeline& m_timeline;
+
+    // currently visible version of the object in each slot or nullptr
+    std::vector<const osmium::OSMObject*> m_state;
+
+    std::size_t m_next_event = 0;
+    osmium::Timestamp m_time;
+
+public:
+
+    explicit TimelineCursor(const Timeline& timeline) :
+        m_timeline(timeline),
+        m_state(timeline.num_slots(), nullptr),
+        m_time(osmium::start_of_time()) {
+    }
+
+    /**
+     * Apply all events up to and including point_in_time. Points in time
+     * must not decrease between calls.
+     */
+    void advance_to(osmium::Timestamp point_in_time) {
+        assert(point_in_time >= m_time);
+        m_time = point_in_time;
+
+        const auto& events = m_timeline.events();
+        for (; m_next_event < events.size() && events[m_next_event].time <= point_in_time; ++m_next_event) {
+            const auto& e = events[m_next_event];
+            if (e.add) {
+                m_state[e.slot] = e.object;
+            } else if (m_state[e.slot] == e.object) {
+                m_state[e.slot] = nullptr;
+            }
+        }
+    }
+
+    /**
+     * Move to point_in_time and copy all nodes and ways visible then into
+     * fbuffer and all relations into rbuffer, in the same order they had
+     * in the input.
+     */
+    void snapshot(osmium::Timestamp point_in_time, osmium::memory::Buffer& fbuffer, osmium::memory::Buffer& rbuffer) {
+        advance_to(point_in_time);
+
+        for (uint32_t slot = 0; slot < m_state.size(); ++slot) {
+            if (m_state[slot]) {
+                auto& buffer = slot < m_timeline.first_relation_slot() ? fbuffer : rbuffer;
+                buffer.add_item(*m_state[slot]);
+                buffer.commit();
+            }
+        }
+    }
+
+}; // class TimelineCursor
+
+#endif // TIMELINE_HPP
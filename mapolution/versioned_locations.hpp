@@ -0,0 +1,132 @@
+#ifndef VERSIONED_LOCATIONS_HPP
+#define VERSIONED_LOCATIONS_HPP
+
+// The code in this file is released into the Public Domain.
+
+#include <algorithm>
+#include <tuple>
+#include <vector>
+
+#include <osmium/handler.hpp>
+#include <osmium/memory/buffer.hpp>
+#include <osmium/osm/box.hpp>
+#include <osmium/osm/location.hpp>
+#include <osmium/osm/node.hpp>
+#include <osmium/osm/object.hpp>
+#include <osmium/osm/timestamp.hpp>
+#include <osmium/osm/types.hpp>
+#include <osmium/osm/way.hpp>
+
+/**
+ * Index with the locations of all versions of all nodes in the history
+ * data. It is built once and can then answer the question "where was
+ * node N at time t" for any point in time. Versions which don't change
+ * the location of a node are not stored. Deleted nodes have an invalid
+ * location.
+ *
+ * This class is immutable after construction, so it can be shared between
+ * threads.
+ */
+class VersionedLocations {
+
+    struct entry {
+        osmium::object_id_type id;
+        osmium::Timestamp valid_from;
+        osmium::Location location;
+
+        friend bool operator<(const entry& lhs, const entry& rhs) noexcept {
+            return std::make_tuple(lhs.id, lhs.valid_from) < std::make_tuple(rhs.id, rhs.valid_from);
+        }
+    };
+
+    // sorted by id and time
+    std::vector<entry> m_entries;
+
+public:
+
+    using iterator = osmium::memory::Buffer::t_iterator<osmium::OSMObject>;
+
+    VersionedLocations(iterator begin, iterator end) {
+        for (auto it = begin; it != end; ++it) {
+            if (it->type() != osmium::item_type::node) {
+                continue;
+            }
+            const auto& node = static_cast<const osmium::Node&>(*it);
+            const osmium::Location location = node.visible() ? node.location() : osmium::Location{};
+            if (!m_entries.empty() && m_entries.back().id == node.id() && m_entries.back().location == location) {
+                continue;
+            }
+            m_entries.push_back(entry{node.id(), node.timestamp(), location});
+        }
+
+        // History files are sorted by id and version, so this usually
+        // doesn't have to do anything. It must be stable so that of several
+        // versions with the same timestamp the last one wins.
+        std::stable_sort(m_entries.begin(), m_entries.end());
+        m_entries.shrink_to_fit();
+    }
+
+    /**
+     * Get location of node with the given id at point_in_time. Returns an
+     * invalid location if the node didn't exist or was deleted then.
+     */
+    osmium::Location get(osmium::object_id_type id, osmium::Timestamp point_in_time) const noexcept {
+        const entry key{id, point_in_time, osmium::Location{}};
+        auto it = std::upper_bound(m_entries.cbegin(), m_entries.cend(), key);
+        if (it == m_entries.cbegin()) {
+            return osmium::Location{};
+        }
+        --it;
+        return it->id == id ? it->location : osmium::Location{};
+    }
+
+    /**
+     * The bounding box of all locations any node ever had.
+     */
+    osmium::Box bounding_box() const noexcept {
+        osmium::Box box;
+        for (const auto& e : m_entries) {
+            if (e.location.valid()) {
+                box.extend(e.location);
+            }
+        }
+        return box;
+    }
+
+    std::size_t size() const noexcept {
+        return m_entries.size();
+    }
+
+    std::size_t used_memory() const noexcept {
+        return m_entries.capacity() * sizeof(entry);
+    }
+
+}; // class VersionedLocations
+
+/**
+ * Handler setting the node locations of all ways to the locations those
+ * nodes had at the given point in time. Use instead of
+ * osmium::handler::NodeLocationsForWays if there is a VersionedLocations
+ * index. Locations of missing nodes are left invalid.
+ */
+class VersionedLocationsForWays : public osmium::handler::Handler {
+
+    const VersionedLocations& m_locations;
+    osmium::Timestamp m_point_in_time;
+
+public:
+
+    VersionedLocationsForWays(const VersionedLocations& locations, osmium::Timestamp point_in_time) :
+        m_locations(locations),
+        m_point_in_time(point_in_time) {
+    }
+
+    void way(osmium::Way& way) const {
+        for (auto& node_ref : way.nodes()) {
+            node_ref.set_location(m_locations.get(node_ref.ref(), m_point_in_time));
+        }
+    }
+
+}; // class VersionedLocationsForWays
+
+#endif // VERSIONED_LOCATIONS_HPP
@@ -3,8 +3,99 @@
 
 #include "cmdline_options.hpp"
 
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+
 #include <boost/program_options.hpp>
 
+void Options::add_timestamp(const std::string& str) {
+    const auto begin = str.find_first_not_of(" \t\r");
+    if (begin == std::string::npos) {
+        return; // ignore empty lines
+    }
+    std::string t{str.substr(begin, str.find_last_not_of(" \t\r") - begin + 1)};
+
+    // Allow dates without time
+    if (t.size() == 10) {
+        t.append("T00:00:00Z");
+    }
+
+    try {
+        timestamps.emplace_back(t.c_str());
+    } catch (const std::invalid_argument&) {
+        std::cerr << "Can't understand timestamp '" << str << "', format should be YYYY-MM-DD or YYYY-MM-DDThh:mm:ssZ.\n";
+        std::exit(return_code::fatal);
+    }
+}
+
+void Options::add_category(const std::string& str) {
+    const auto equal = str.find('=');
+    if (equal == 0 || equal == std::string::npos || equal == str.size() - 1) {
+        std::cerr << "Can't understand category '" << str << "', format should be NAME=SPEC.\n";
+        std::exit(return_code::fatal);
+    }
+
+    const std::string name{str.substr(0, equal)};
+    const std::string spec{str.substr(equal + 1)};
+
+    // Several specs with the same name are combined
+    auto it = std::find_if(categories.begin(), categories.end(), [&name](const Category& c) {
+        return c.name == name;
+    });
+    if (it == categories.end()) {
+        if (categories.size() == max_categories) {
+            std::cerr << "Too many categories (max " << max_categories << ").\n";
+            std::exit(return_code::fatal);
+        }
+        categories.emplace_back();
+        it = std::prev(categories.end());
+        it->name = name;
+        it->type = Category::match_type::tags;
+    } else if (it->type != Category::match_type::tags) {
+        std::cerr << "Category '" << name << "' can not be combined with other specs.\n";
+        std::exit(return_code::fatal);
+    }
+
+    if (spec == "all" || spec == "tagged" || spec == "untagged") {
+        if (!it->filter.empty()) {
+            std::cerr << "Category '" << name << "' can not be combined with other specs.\n";
+            std::exit(return_code::fatal);
+        }
+        it->type = spec == "all" ? Category::match_type::all :
+                   spec == "tagged" ? Category::match_type::tagged :
+                                      Category::match_type::untagged;
+        return;
+    }
+
+    const auto value_start = spec.find('=');
+    const std::string key{spec.substr(0, value_start)};
+    const std::string values{value_start == std::string::npos ? "*" : spec.substr(value_start + 1)};
+    if (key.empty() || values.empty()) {
+        std::cerr << "Can't understand category '" << str << "', format should be NAME=KEY[=VALUE[,VALUE...]].\n";
+        std::exit(return_code::fatal);
+    }
+
+    if (values == "*") {
+        it->filter.add_rule(true, osmium::TagMatcher{key});
+        return;
+    }
+
+    std::vector<std::string> value_list;
+    std::string::size_type start = 0;
+    while (true) {
+        const auto comma = values.find(',', start);
+        value_list.push_back(values.substr(start, comma - start));
+        if (comma == std::string::npos) {
+            break;
+        }
+        start = comma + 1;
+    }
+    it->filter.add_rule(true, osmium::TagMatcher{osmium::StringMatcher::equal{key},
+                                                 osmium::StringMatcher::list{value_list}});
+}
+
 Options::Options(int argc, char* argv[]) {
     namespace po = boost::program_options;
 
@@ -25,6 +116,10 @@ Options::Options(int argc, char* argv[]) {
             ("top,Y", po::value<double>(), "Top edge of bounding box (default: 90)")
             ("compression", po::value<std::string>(), "Compression format (NONE, DEFLATE, or LZW (default: LZW))")
             ("build-overviews", "Build overview images")
+            ("category,c", po::value<std::vector<std::string>>(), "Count nodes in category NAME=SPEC into their own band, SPEC is KEY[=VALUE[,VALUE...]], KEY=*, all, tagged, or untagged (can be given multiple times)")
+            ("timestamps,t", po::value<std::string>(), "Comma-separated list of timestamps, one band with the nodes visible at each of them is created (use with history file)")
+            ("timestamps-file,T", po::value<std::string>(), "Like --timestamps, but read timestamps from file (one per line)")
+            ("stats-json", po::value<std::string>(), "Write statistics (timing, counters, memory use) as JSON to this file")
         ;
 
         po::options_description hidden{"Hidden options"};
@@ -93,6 +188,49 @@ Options::Options(int argc, char* argv[]) {
             build_overview = true;
         }
 
+        if (vm.count("category")) {
+            for (const auto& category : vm["category"].as<std::vector<std::string>>()) {
+                add_category(category);
+            }
+        }
+
+        if (vm.count("timestamps")) {
+            const std::string list{vm["timestamps"].as<std::string>()};
+            std::string::size_type start = 0;
+            while (true) {
+                const auto comma = list.find(',', start);
+                add_timestamp(list.substr(start, comma - start));
+                if (comma == std::string::npos) {
+                    break;
+                }
+                start = comma + 1;
+            }
+        }
+
+        if (vm.count("timestamps-file")) {
+            const std::string filename{vm["timestamps-file"].as<std::string>()};
+            std::ifstream file{filename};
+            if (!file) {
+                std::cerr << "Can't open timestamps file '" << filename << "'.\n";
+                std::exit(return_code::fatal);
+            }
+            std::string line;
+            while (std::getline(file, line)) {
+                add_timestamp(line);
+            }
+        }
+
+        std::sort(timestamps.begin(), timestamps.end());
+        timestamps.erase(std::unique(timestamps.begin(), timestamps.end()), timestamps.end());
+        if (timestamps.size() > 65535) {
+            std::cerr << "Too many timestamps.\n";
+            std::exit(return_code::fatal);
+        }
+
+        if (vm.count("stats-json")) {
+            stats_filename = vm["stats-json"].as<std::string>();
+        }
+
         if (vm.count("compression")) {
             const std::string c{vm["compression"].as<std::string>()};
             if (c == "NONE" || c == "LZW" || c == "DEFLATE") {
@@ -3,10 +3,14 @@
 
 // The code in this file is released into the Public Domain.
 
+#include <cstdint>
 #include <string>
+#include <vector>
 
 #include <osmium/osm/box.hpp>
+#include <osmium/osm/tag.hpp>
 #include <osmium/osm/timestamp.hpp>
+#include <osmium/tags/tags_filter.hpp>
 #include <osmium/util/verbose_output.hpp>
 
 enum return_code : int {
@@ -15,21 +19,76 @@ enum return_code : int {
     fatal = 2
 };
 
+/**
+ * A category of nodes counted into their own band(s).
+ */
+struct Category {
+
+    enum class match_type {
+        all,      // all nodes
+        tagged,   // nodes with any tags
+        untagged, // nodes without tags
+        tags      // nodes with tags matching the filter
+    };
+
+    std::string name;
+    match_type type = match_type::all;
+    osmium::TagsFilter filter{false};
+
+    // Tag lists are checked by the caller for being empty, so this
+    // is only called for nodes with tags.
+    bool matches_tags(const osmium::TagList& tags) const {
+        switch (type) {
+            case match_type::all:
+            case match_type::tagged:
+                return true;
+            case match_type::untagged:
+                return false;
+            case match_type::tags:
+                break;
+        }
+        for (const auto& tag : tags) {
+            if (filter(tag)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+}; // struct Category
+
 struct Options {
 
+    // Categories are stored as bits in a 64 bit integer
+    static constexpr const std::size_t max_categories = 64;
+
     osmium::util::VerboseOutput vout {true};
 
     std::string input_filename{"-"};
     std::string output_filename{"out.tif"};
     std::string input_format;
     std::string compression_format{"LZW"};
+    std::string stats_filename;
     bool build_overview = false;
     std::size_t width = 1024;
     std::size_t height = 1024;
     osmium::Box box{-180, -90, 180, 90};
 
+    // One band per timestamp (sorted) with the nodes visible at that time.
+    // If empty, there is one band with all nodes.
+    std::vector<osmium::Timestamp> timestamps;
+
+    // Categories of nodes counted separately. If empty, there is one
+    // category with all nodes. There are bands for each combination of
+    // category and timestamp.
+    std::vector<Category> categories;
+
     Options(int argc, char* argv[]);
 
+    void add_timestamp(const std::string& str);
+
+    void add_category(const std::string& str);
+
 }; // struct Options
 
 #endif // CMDLINE_OPTIONS_HPP
@@ -4,9 +4,12 @@
 #include <algorithm>
 #include <cassert>
 #include <cmath>
+#include <cstdint>
 #include <cstdio>
 #include <iostream>
+#include <iterator>
 #include <limits>
+#include <stdexcept>
 #include <string>
 #include <vector>
 
@@ -25,6 +28,7 @@
 #include <osmium/geom/mercator_projection.hpp>
 
 #include "cmdline_options.hpp"
+#include "run_stats.hpp"
 
 // Set to 16 or 32 bit
 using node_count_type = uint16_t;
@@ -45,22 +49,107 @@ class NodeDensityHandler : public osmium::handler::Handler {
     const double m_factor_x;
     const double m_factor_y;
 
+    // One band for each combination of category and timestamp. If there
+    // are no categories or no timestamps, there is one of each.
+    const std::size_t m_num_categories;
+    const std::size_t m_num_timestamps;
+    const std::size_t m_num_bands;
+    const std::size_t m_band_size;
+
+    // The counters for all bands, one band after the other
     std::unique_ptr<node_count_type[]> m_node_count;
 
+    // Last node version seen. It is valid until the next version of the
+    // same node or forever if there is none.
+    osmium::object_id_type m_last_id = 0;
+    osmium::Timestamp m_last_timestamp;
+    osmium::Location m_last_location;
+    uint64_t m_last_categories = 0;
+
+    uint64_t m_nodes = 0;
+    uint64_t m_nodes_in_box = 0;
+
     static int in_range(int min, int value, int max) {
         return std::min(std::max(value, min), max);
     }
 
-    void record_location(const osmium::Location& location) {
-        if (m_options.box.contains(location)) {
-            const osmium::geom::Coordinates c = m_projection(location);
-            const std::size_t x = in_range(0, (c.x - m_bottom_left.x) * m_factor_x, m_width  - 1);
-            const std::size_t y = in_range(0, (c.y - m_top_right.y)   * m_factor_y, m_height - 1);
-            const std::size_t n = y * m_width + x;
-            if (m_node_count[n] < std::numeric_limits<node_count_type>::max()) {
-                ++m_node_count[n];
+    void increment(std::size_t n) noexcept {
+        if (m_node_count[n] < std::numeric_limits<node_count_type>::max()) {
+            ++m_node_count[n];
+        }
+    }
+
+    // Bit mask with the categories the node with these tags is in.
+    uint64_t category_mask(const osmium::TagList& tags) const {
+        if (m_options.categories.empty()) {
+            return 1;
+        }
+
+        uint64_t mask = 0;
+        for (std::size_t i = 0; i < m_options.categories.size(); ++i) {
+            const auto& category = m_options.categories[i];
+            // Most nodes have no tags, they don't need the tag matching.
+            const bool match = tags.empty() ? (category.type == Category::match_type::all ||
+                                               category.type == Category::match_type::untagged)
+                                            : category.matches_tags(tags);
+            if (match) {
+                mask |= uint64_t{1} << i;
+            }
+        }
+        return mask;
+    }
+
+    // Count location in the bands of all categories in the mask with
+    // timestamps in [from, to).
+    void record_location(const osmium::Location& location, uint64_t mask, const osmium::Timestamp& from, const osmium::Timestamp& to) {
+        if (mask == 0 || !m_options.box.contains(location)) {
+            return;
+        }
+
+        const auto& timestamps = m_options.timestamps;
+        const auto first = std::lower_bound(timestamps.cbegin(), timestamps.cend(), from);
+        const auto last = std::lower_bound(first, timestamps.cend(), to);
+        if (!timestamps.empty() && first == last) {
+            return;
+        }
+
+        ++m_nodes_in_box;
+        const osmium::geom::Coordinates c = m_projection(location);
+        const std::size_t x = in_range(0, (c.x - m_bottom_left.x) * m_factor_x, m_width  - 1);
+        const std::size_t y = in_range(0, (c.y - m_top_right.y)   * m_factor_y, m_height - 1);
+        const std::size_t n = y * m_width + x;
+
+        const std::size_t first_band = timestamps.empty() ? 0 : std::distance(timestamps.cbegin(), first);
+        const std::size_t last_band = timestamps.empty() ? 1 : std::distance(timestamps.cbegin(), last);
+        for (std::size_t category = 0; category < m_num_categories; ++category) {
+            if (mask & (uint64_t{1} << category)) {
+                for (std::size_t t = first_band; t < last_band; ++t) {
+                    increment((category * m_num_timestamps + t) * m_band_size + n);
+                }
+            }
+        }
+    }
+
+    void flush_last(const osmium::Timestamp& valid_to) {
+        if (m_last_id != 0 && m_last_location.valid()) {
+            record_location(m_last_location, m_last_categories, m_last_timestamp, valid_to);
+        }
+        m_last_id = 0;
+    }
+
+    // Band description from category name and timestamp
+    std::string band_description(std::size_t band) const {
+        std::string description;
+        if (!m_options.categories.empty()) {
+            description = m_options.categories[band / m_num_timestamps].name;
+        }
+        if (!m_options.timestamps.empty()) {
+            if (!description.empty()) {
+                description += ' ';
             }
+            description += m_options.timestamps[band % m_num_timestamps].to_iso();
         }
+        return description;
     }
 
 public:
@@ -73,7 +162,11 @@ public:
         m_top_right(m_projection(options.box.top_right())),
         m_factor_x(m_width  / (m_top_right.x - m_bottom_left.x)),
         m_factor_y(- m_height / (m_top_right.y - m_bottom_left.y)),
-        m_node_count(new node_count_type[options.width * options.height]) {
+        m_num_categories(std::max(options.categories.size(), std::size_t{1})),
+        m_num_timestamps(std::max(options.timestamps.size(), std::size_t{1})),
+        m_num_bands(m_num_categories * m_num_timestamps),
+        m_band_size(options.width * options.height),
+        m_node_count(new node_count_type[m_num_bands * m_band_size]()) {
         if (!m_node_count) {
             std::cerr << "Could not allocate memory\n";
             std::exit(return_code::error);
@@ -81,14 +174,40 @@ public:
     }
 
     void node(const osmium::Node& node) {
-        record_location(node.location());
+        ++m_nodes;
+
+        if (m_options.timestamps.empty()) {
+            record_location(node.location(), category_mask(node.tags()), osmium::start_of_time(), osmium::end_of_time());
+            return;
+        }
+
+        // Versions of the same node are next to each other in a history
+        // file, each one is valid until the next one.
+        flush_last(node.id() == m_last_id ? node.timestamp() : osmium::end_of_time());
+        m_last_id = node.id();
+        m_last_timestamp = node.timestamp();
+        m_last_location = node.visible() ? node.location() : osmium::Location{};
+        m_last_categories = node.visible() ? category_mask(node.tags()) : 0;
+    }
+
+    // Call after all nodes have been read.
+    void done() {
+        flush_last(osmium::end_of_time());
+    }
+
+    uint64_t nodes() const noexcept {
+        return m_nodes;
+    }
+
+    uint64_t nodes_in_box() const noexcept {
+        return m_nodes_in_box;
     }
 
     void write_to_file() {
         m_options.vout << "Maximum node count per pixel: "
                        << *std::max_element(
                               &m_node_count[0],
-                              &m_node_count[m_options.width * m_options.height])
+                              &m_node_count[m_num_bands * m_band_size])
                        << "\n";
 
         GDALAllRegister();
@@ -99,7 +218,7 @@ public:
             std::exit(return_code::fatal);
         }
 
-        GDALDataset* dataset = driver_mem->Create("", m_width, m_height, 1, IMAGE_TYPE, nullptr);
+        GDALDataset* dataset = driver_mem->Create("", m_width, m_height, static_cast<int>(m_num_bands), IMAGE_TYPE, nullptr);
         if (!dataset) {
             std::cerr << "Can't create output file '" << m_options.output_filename <<"'.\n";
             std::exit(return_code::error);
@@ -117,6 +236,23 @@ public:
             CPLFree(wkt);
         }
 
+        // The COG driver can only create copies of other datasets, so the
+        // counters are written into the in-memory dataset first.
+        for (std::size_t i = 0; i < m_num_bands; ++i) {
+            GDALRasterBand* band = dataset->GetRasterBand(static_cast<int>(i + 1));
+            assert(band);
+            const std::string description{band_description(i)};
+            if (!description.empty()) {
+                band->SetDescription(description.c_str());
+            }
+            if (band->RasterIO(GF_Write, 0, 0, m_width, m_height, &m_node_count[i * m_band_size], m_width, m_height, IMAGE_TYPE, 0, 0) != CE_None) {
+                std::cerr << "Error writing to output file '" << m_options.output_filename <<"'.\n";
+                std::exit(return_code::error);
+            }
+        }
+
+        m_node_count.reset();
+
         GDALDriver* driver_cog = GetGDALDriverManager()->GetDriverByName("COG");
         if (!driver_cog) {
             std::cerr << "Can't initalize GDAL COG driver.\n";
@@ -134,7 +270,7 @@ public:
         dataset_options[options.size()] = nullptr;
 
         GDALDataset* dataset_cog = driver_cog->CreateCopy(m_options.output_filename.c_str(), dataset, 0, dataset_options.get(), nullptr, nullptr);
-        if (!dataset) {
+        if (!dataset_cog) {
             std::cerr << "Can't create output file '" << m_options.output_filename <<"'.\n";
             std::exit(return_code::error);
         }
@@ -143,15 +279,6 @@ public:
         dataset_cog->SetMetadataItem("TIFFTAG_COPYRIGHT", "Copyright OpenStreetMap contributors (https://www.openstreetmap.org/copyright), License: CC-BY-SA (https://creativecommons.org/licenses/by-sa/2.0/)");
         dataset_cog->SetMetadataItem("TIFFTAG_SOFTWARE", "node_density");
 
-        GDALRasterBand* band = dataset_cog->GetRasterBand(1);
-        assert(band);
-        if (band->RasterIO(GF_Write, 0, 0, m_width, m_height, m_node_count.get(), m_width, m_height, IMAGE_TYPE, 0, 0) != CE_None) {
-            std::cerr << "Error writing to output file '" << m_options.output_filename <<"'.\n";
-            std::exit(return_code::error);
-        }
-
-        m_node_count.reset();
-
         m_options.vout << "Building overview...\n";
         {
             int num = std::log2(m_width / 256.0);
@@ -202,23 +329,56 @@ int main(int argc, char* argv[]) {
     options.vout << "  Bounding box:             " << options.box << "\n";
     options.vout << "  Compression:              " << options.compression_format << "\n";
     options.vout << "  Build overviews:          " << (options.build_overview ? "yes" : "no") << "\n";
+    if (!options.timestamps.empty()) {
+        options.vout << "  Timestamps:               " << options.timestamps.front();
+        if (options.timestamps.size() > 1) {
+            options.vout << " ... " << options.timestamps.back() << " (" << options.timestamps.size() << " bands)";
+        }
+        options.vout << "\n";
+    }
+
+    for (const auto& category : options.categories) {
+        options.vout << "  Category:                 " << category.name << "\n";
+    }
 
     options.vout << "Will need "
-                 << (options.width * options.height * sizeof(node_count_type) /
-                     (1024UL * 1024UL))
+                 << (options.width * options.height *
+                     std::max(options.timestamps.size(), std::size_t{1}) *
+                     std::max(options.categories.size(), std::size_t{1}) *
+                     sizeof(node_count_type) / (1024UL * 1024UL))
                  << " MByte RAM for counters.\n";
 
+    RunStats stats{"node_density"};
+
     NodeDensityHandler handler{options};
 
     osmium::io::File file{options.input_filename, options.input_format};
     osmium::io::Reader reader{file, osmium::osm_entity_bits::node};
 
     options.vout << "Counting nodes...\n";
-    osmium::apply(reader, handler);
+    {
+        const auto phase = stats.phase("read");
+        osmium::apply(reader, handler);
+        handler.done();
+    }
+    stats.add("nodes", handler.nodes());
+    stats.add("nodes_in_box", handler.nodes_in_box());
     options.vout << "Done.\n";
 
     options.vout << "Writing image to output file...\n";
-    handler.write_to_file();
+    {
+        const auto phase = stats.phase("write");
+        handler.write_to_file();
+    }
     options.vout << "Done.\n";
+
+    if (!options.stats_filename.empty()) {
+        try {
+            stats.write_json(options.stats_filename);
+        } catch (const std::runtime_error& e) {
+            std::cerr << e.what() << "\n";
+            std::exit(return_code::error);
+        }
+    }
 }
 